@@ -0,0 +1,92 @@
+#pragma once
+#include <new>
+#include <vector>
+#include <unordered_map>
+#include "llvm/Support/Allocator.h"
+using namespace std;
+
+// Bump allocator owning every AST node, scope, tag and object of a
+// translation unit. Nothing in it is destroyed one by one: the memory is
+// handed out by bumping a pointer and released in one go with the arena.
+// Constructing an arena makes it the current one for this thread.
+struct arena
+{
+    arena() : previous(current)
+    {
+        current = this;
+    }
+
+    ~arena()
+    {
+        current = previous;
+    }
+
+    arena(const arena&) = delete;
+    arena& operator = (const arena&) = delete;
+
+    void* allocate(size_t size, size_t align)
+    {
+        return allocator.Allocate(size, align);
+    }
+
+    static thread_local arena* current;
+
+private:
+    llvm::BumpPtrAllocator allocator;
+    arena* previous;
+};
+
+// Constructs a T in the current arena. The destructor never runs.
+template <class T, class... Args>
+T* make(Args&&... args)
+{
+    return new (arena::current->allocate(sizeof(T), alignof(T)))
+        T(forward<Args>(args)...);
+}
+
+// Standard allocator adaptor so that containers inside AST nodes live in the
+// same arena as the nodes themselves. Deallocation is a no-op.
+template <class T>
+struct arena_allocator
+{
+    using value_type = T;
+
+    arena_allocator() : owner(arena::current)
+    {
+    }
+
+    template <class U>
+    arena_allocator(const arena_allocator<U>& other) : owner(other.owner)
+    {
+    }
+
+    T* allocate(size_t n)
+    {
+        return (T*)owner->allocate(n * sizeof(T), alignof(T));
+    }
+
+    void deallocate(T*, size_t)
+    {
+    }
+
+    arena* owner;
+};
+
+template <class T, class U>
+bool operator == (const arena_allocator<T>& a, const arena_allocator<U>& b)
+{
+    return a.owner == b.owner;
+}
+
+template <class T, class U>
+bool operator != (const arena_allocator<T>& a, const arena_allocator<U>& b)
+{
+    return a.owner != b.owner;
+}
+
+template <class T>
+using avector = vector<T, arena_allocator<T>>;
+
+template <class K, class V>
+using amap = unordered_map<K, V, hash<K>, equal_to<K>,
+                           arena_allocator<pair<const K, V>>>;
@@ -1,14 +1,27 @@
 #pragma once
 #include "error.h"
 #include <map>
+#include <unordered_map>
+#include "compilation.h"
 #include "llvm/IR/IRBuilder.h"
 using namespace llvm;
 
+enum object_kind
+{
+    OBJECT_VARIABLE,
+    OBJECT_FUNCTION
+};
+
+// What a declaration declares. The parser binds every declarator and every
+// use of a name to its object, so codegen never looks a name up.
 struct object
 {
-    virtual ~object()
+    object(object_kind kind) : kind(kind)
     {
     }
+
+    object_kind kind;
+    bool internal = false; // declared static, so its symbol stays in the unit
 };
 
 struct function_object : object
@@ -18,14 +31,21 @@ struct function_object : object
     FunctionType *type = nullptr;
     Function *function = nullptr;
     bool is_defined;
+    // every declaration at file scope says inline and none extern, so a
+    // definition is only there to be inlined (C99 6.7.4)
+    bool inline_only = true;
 };
 
 
 struct variable_object : object
 {
-    variable_object(Type *type);
+    variable_object(Type *type, bool global);
     Value *store = nullptr;
     Type *type = nullptr;
+    bool global; // of static storage duration, so stored in a global variable
+    bool address_taken = false; // by &, so it cannot be kept in registers
+    bool is_defined = false; // by a declaration without extern, if global
+    bool has_initializer = false;
 };
 
 struct struct_declaration;
@@ -33,11 +53,11 @@ struct struct_declaration;
 struct tag
 {
     tag();
-    void complete(vector<struct_declaration*>& sds);
+    void complete(avector<struct_declaration*>& sds);
 
     bool is_complete;
-    string h; // h stands for i Hate my life
-    map<string, int> indices;
+    int id; // in order of creation; names the struct type
+    amap<symbol, int> indices;
     StructType *type;
 };
 
@@ -46,16 +66,9 @@ struct scope
     scope(bool global) : global(global)
     {
     }
-    ~scope()
-    {
-        for (auto [str, obj] : vars)
-            delete obj;
-        for (auto [str, obj] : tags)
-            delete obj;
-    }
     bool global;
-    map<string, object*> vars;
-    map<string, tag*> tags;
+    amap<symbol, object*> vars;
+    amap<symbol, tag*> tags;
 };
 
 struct declspec
@@ -88,6 +101,7 @@ struct builtin_type_specifier : type_specifier
 };
 
 struct declarator;
+struct expression;
 struct struct_or_union_specifier;
 
 struct struct_declaration
@@ -96,8 +110,8 @@ struct struct_declaration
 
     Type *type;
     struct_or_union_specifier* sus = nullptr;
-    vector<specifier_qualifier*> sqs;
-    vector<declarator*> ds;
+    avector<specifier_qualifier*> sqs;
+    avector<declarator*> ds;
 };
 
 struct struct_or_union_specifier : type_specifier
@@ -107,7 +121,7 @@ struct struct_or_union_specifier : type_specifier
     token sou;
     token id;
     bool has_sds = false;
-    vector<struct_declaration*> sds;
+    avector<struct_declaration*> sds;
 };
 
 struct type_name
@@ -116,7 +130,7 @@ struct type_name
 
     Type* type;
     struct_or_union_specifier* sus = nullptr;
-    vector<specifier_qualifier*> sqs;
+    avector<specifier_qualifier*> sqs;
     declarator* ad = nullptr;
 };
 
@@ -127,7 +141,10 @@ struct declaration_specifiers
     token tok;
     Type *type;
     struct_or_union_specifier* sus = nullptr;
-    vector<declspec*> declspecs;
+    avector<declspec*> declspecs;
+    bool is_static = false;
+    bool is_extern = false;
+    bool is_inline = false;
 };
 
 struct storage_class_specifier : declspec
@@ -146,7 +163,6 @@ struct function_specifier : declspec
 
 struct direct_declarator
 {
-    virtual ~direct_declarator() {}
     virtual void print();
     virtual token get_identifier();
     virtual bool is_definition(); // is function pointer
@@ -189,14 +205,25 @@ struct function_declarator : direct_declarator
 
     token op;
     direct_declarator* dd;
-    vector<parameter_declaration*> pl;
+    avector<parameter_declaration*> pl;
 };
 
 struct pointer
 {
     void print();
 
-    vector<type_qualifier*> tql;
+    avector<type_qualifier*> tql;
+};
+
+// An expression, or braces around the initializers of the members of a
+// struct in order.
+struct initializer
+{
+    void print();
+
+    token tok;
+    expression* expr = nullptr; // nullptr for braces
+    avector<initializer*> list;
 };
 
 struct declarator
@@ -208,556 +235,240 @@ struct declarator
     Value* codegen();
 
     Type *gen_type(Type *type);
-    vector<pointer*> p;
+    avector<pointer*> p;
     direct_declarator* dd = nullptr;
+    object* obj = nullptr; // what it declares, if anything
+    initializer* init = nullptr;
 };
 
 struct declaration
 {
-    ~declaration();
     void print();
     void codegen();
 
     declaration_specifiers* ds;
-    vector<declarator*> d;
+    avector<declarator*> d;
 };
 
-struct expression;
-
-struct primary_expression
-{
-    virtual ~primary_expression();
-    virtual void print();
-    virtual Value* make_lvalue();
-    virtual Value* make_rvalue();
-
-    object* var = nullptr;
-    token tok;
-};
-
-struct parenthesized_expression : primary_expression
-{
-    ~parenthesized_expression();
-    void print();
-    Value* make_lvalue();
-    Value* make_rvalue();
-
-    expression* expr;
-};
-
-struct postfix_expression
-{
-    virtual ~postfix_expression();
-    virtual void print();
-    virtual Value* make_lvalue();
-    virtual Value* make_rvalue();
-
-    token op;
-    postfix_expression* pfe = nullptr;
-    primary_expression* pe = nullptr;
-};
-
-struct subscript_expression : postfix_expression
-{
-    ~subscript_expression();
-    void print();
-    Value* make_lvalue();
-    Value* make_rvalue();
-
-    token op;
-    expression* expr;
-};
-
-struct assignment_expression;
-
-struct call_expression : postfix_expression
+// Every expression node stands for one operation of the source: the
+// single-child levels of the C grammar and parentheses leave no node behind.
+struct expression
 {
-    ~call_expression();
-    void print();
-    Value* make_lvalue();
-    Value* make_rvalue();
-
-    token opop;
-    vector<assignment_expression*> args;
-};
+    virtual void print() = 0;
+    virtual Value* make_lvalue(); // nullptr unless the result is an lvalue
+    virtual Value* make_rvalue() = 0;
 
-struct dot_expression : postfix_expression
-{
-    void print();
-    Value* make_lvalue();
-    Value* make_rvalue();
+    // The value of an integer constant expression from the values of its
+    // operands, set as value by the parser; nullptr if it is none.
+    virtual ConstantInt* fold();
+    ConstantInt* value = nullptr;
 
-    token id;
+    // The type of what make_rvalue gives, found without emitting any code;
+    // nullptr where make_rvalue would reject the expression.
+    virtual Type* static_type() = 0;
 };
 
-struct arrow_expression : postfix_expression
+struct primary_expression : expression
 {
     void print();
+    ConstantInt* fold();
     Value* make_lvalue();
     Value* make_rvalue();
+    Type* static_type();
 
-    token id;
-};
-
-struct postfix_increment_expression : postfix_expression
-{
-    void print();
-    Value* make_lvalue();
-    Value* make_rvalue();
+    object* var = nullptr;
+    token tok;
 };
 
-struct postfix_decrement_expression : postfix_expression
+struct subscript_expression : expression
 {
     void print();
     Value* make_lvalue();
     Value* make_rvalue();
-};
-
-struct unary_expression
-{
-    virtual ~unary_expression();
-    virtual void print();
-    virtual Value* make_lvalue();
-    virtual Value* make_rvalue();
+    Type* static_type();
 
     token op;
-    postfix_expression* pe = nullptr;
-};
-
-struct prefix_increment_expression : unary_expression
-{
-    ~prefix_increment_expression();
-    void print();
-    Value* make_lvalue();
-    Value* make_rvalue();
-
-    unary_expression* ue;
-};
-
-struct prefix_decrement_expression : unary_expression
-{
-    ~prefix_decrement_expression();
-    void print();
-    Value* make_lvalue();
-    Value* make_rvalue();
-
-    unary_expression* ue;
-};
-
-struct cast_expression;
-
-struct unary_and_expression : unary_expression
-{
-    ~unary_and_expression();
-    void print();
-    Value* make_lvalue();
-    Value* make_rvalue();
-
-    cast_expression* ce;
-};
-
-struct unary_star_expression : unary_expression
-{
-    ~unary_star_expression();
-    void print();
-    Value* make_lvalue();
-    Value* make_rvalue();
-
-    cast_expression* ce;
-};
-
-struct unary_plus_expression : unary_expression
-{
-    ~unary_plus_expression();
-    void print();
-    Value* make_lvalue();
-    Value* make_rvalue();
-
-    cast_expression* ce;
-};
-
-struct unary_minus_expression : unary_expression
-{
-    ~unary_minus_expression();
-    void print();
-    Value* make_lvalue();
-    Value* make_rvalue();
-
-    cast_expression* ce;
-};
-
-struct unary_tilde_expression : unary_expression
-{
-    ~unary_tilde_expression();
-    void print();
-    Value* make_lvalue();
-    Value* make_rvalue();
-
-    cast_expression* ce;
-};
-
-struct unary_not_expression : unary_expression
-{
-    ~unary_not_expression();
-    void print();
-    Value* make_lvalue();
-    Value* make_rvalue();
-
-    cast_expression* ce;
-};
-
-struct sizeof_expression : unary_expression
-{
-    ~sizeof_expression();
-    void print();
-    Value* make_lvalue();
-    Value* make_rvalue();
-
-    unary_expression* ue;
+    expression* pfe;
+    expression* expr;
 };
 
-struct sizeof_type_expression : unary_expression
+struct call_expression : expression
 {
-    ~sizeof_type_expression();
     void print();
-    Value* make_lvalue();
     Value* make_rvalue();
+    Type* static_type();
 
-    type_name* tn;
+    token op, opop;
+    expression* pfe;
+    avector<expression*> args;
 };
 
-struct cast_expression
+struct dot_expression : expression
 {
-    ~cast_expression();
     void print();
     Value* make_lvalue();
     Value* make_rvalue();
+    Type* static_type();
 
     token op;
-    unary_expression* ue = nullptr;
-    type_name* tn = nullptr;
-    cast_expression* ce = nullptr;
-};
-
-struct multiplicative_expression
-{
-    virtual ~multiplicative_expression();
-    virtual void print();
-    virtual Value* make_lvalue();
-    virtual Value* make_rvalue();
-
-    token op;
-    cast_expression* ce = nullptr;
-};
-
-struct mul_expression : multiplicative_expression
-{
-    ~mul_expression();
-    void print();
-    Value* make_lvalue();
-    Value* make_rvalue();
-
-    multiplicative_expression* lhs;
-    cast_expression* rhs;
-};
-
-struct div_expression : multiplicative_expression
-{
-    ~div_expression();
-    void print();
-    Value* make_lvalue();
-    Value* make_rvalue();
-
-    multiplicative_expression* lhs;
-    cast_expression* rhs;
+    expression* pfe;
+    token id;
 };
 
-struct mod_expression : multiplicative_expression
+struct arrow_expression : expression
 {
-    ~mod_expression();
     void print();
     Value* make_lvalue();
     Value* make_rvalue();
-
-    multiplicative_expression* lhs;
-    cast_expression* rhs;
-};
-
-struct additive_expression
-{
-    virtual ~additive_expression();
-    virtual void print();
-    virtual Value* make_lvalue();
-    virtual Value* make_rvalue();
+    Type* static_type();
 
     token op;
-    multiplicative_expression* me = nullptr;
-};
-
-struct add_expression : additive_expression
-{
-    ~add_expression();
-    void print();
-    Value* make_lvalue();
-    Value* make_rvalue();
-
-    additive_expression* lhs;
-    multiplicative_expression* rhs;
+    expression* pfe;
+    token id;
 };
 
-struct sub_expression : additive_expression
+struct postfix_increment_expression : expression
 {
-    ~sub_expression();
     void print();
-    Value* make_lvalue();
     Value* make_rvalue();
-
-    additive_expression* lhs;
-    multiplicative_expression* rhs;
-};
-
-struct shift_expression
-{
-    virtual ~shift_expression();
-    virtual void print();
-    virtual Value* make_lvalue();
-    virtual Value* make_rvalue();
+    Type* static_type();
 
     token op;
-    additive_expression* ae = nullptr;
+    expression* pfe;
 };
 
-struct rshift_expression : shift_expression
+struct postfix_decrement_expression : expression
 {
-    ~rshift_expression();
     void print();
-    Value* make_lvalue();
-    Value* make_rvalue();
-
-    shift_expression* lhs;
-    additive_expression* rhs;
-};
-
-struct lshift_expression : shift_expression
-{
-    ~lshift_expression();
-    void print();
-    Value* make_lvalue();
     Value* make_rvalue();
-
-    shift_expression* lhs;
-    additive_expression* rhs;
-};
-
-struct relational_expression
-{
-    virtual ~relational_expression();
-    virtual void print();
-    virtual Value* make_lvalue();
-    virtual Value* make_rvalue();
+    Type* static_type();
 
     token op;
-    shift_expression* se = nullptr;
+    expression* pfe;
 };
 
-struct less_expression : relational_expression
+enum unary_op
 {
-    ~less_expression();
-    void print();
-    Value* make_lvalue();
-    Value* make_rvalue();
-
-    relational_expression* lhs;
-    shift_expression* rhs;
-};
-
-struct greater_expression : relational_expression
-{
-    ~greater_expression();
-    void print();
-    Value* make_lvalue();
-    Value* make_rvalue();
-
-    relational_expression* lhs;
-    shift_expression* rhs;
+    UNARY_INCREMENT, UNARY_DECREMENT,
+    UNARY_ADDRESS, UNARY_DEREFERENCE,
+    UNARY_PLUS, UNARY_MINUS, UNARY_COMPLEMENT, UNARY_NOT
 };
 
-struct less_equal_expression : relational_expression
+// Prefix operators other than sizeof.
+struct unary_expression : expression
 {
-    ~less_equal_expression();
     void print();
+    ConstantInt* fold();
     Value* make_lvalue();
     Value* make_rvalue();
+    Type* static_type();
 
-    relational_expression* lhs;
-    shift_expression* rhs;
-};
-
-struct greater_equal_expression : relational_expression
-{
-    ~greater_equal_expression();
-    void print();
-    Value* make_lvalue();
-    Value* make_rvalue();
-
-    relational_expression* lhs;
-    shift_expression* rhs;
-};
-
-struct equality_expression
-{
-    virtual ~equality_expression();
-    virtual void print();
-    virtual Value* make_lvalue();
-    virtual Value* make_rvalue();
-
+    unary_op kind;
     token op;
-    relational_expression* re = nullptr;
-};
-
-struct equal_expression : equality_expression
-{
-    ~equal_expression();
-    void print();
-    Value* make_lvalue();
-    Value* make_rvalue();
-
-    equality_expression* lhs;
-    relational_expression* rhs;
-};
-
-struct not_equal_expression : equality_expression
-{
-    ~not_equal_expression();
-    void print();
-    Value* make_lvalue();
-    Value* make_rvalue();
-
-    equality_expression* lhs;
-    relational_expression* rhs;
+    expression* operand;
 };
 
-struct and_expression
+struct sizeof_expression : expression
 {
-    ~and_expression();
     void print();
-    Value* make_lvalue();
+    ConstantInt* fold();
     Value* make_rvalue();
+    Type* static_type();
 
     token op;
-    equality_expression* ee = nullptr;
-    and_expression* lhs = nullptr;
-    equality_expression* rhs = nullptr;
+    expression* ue;
 };
 
-struct exclusive_or_expression
+struct sizeof_type_expression : expression
 {
-    ~exclusive_or_expression();
     void print();
-    Value* make_lvalue();
+    ConstantInt* fold();
     Value* make_rvalue();
+    Type* static_type();
 
     token op;
-    and_expression* ae = nullptr;
-    exclusive_or_expression* lhs = nullptr;
-    and_expression* rhs = nullptr;
+    type_name* tn;
 };
 
-struct inclusive_or_expression
+struct cast_expression : expression
 {
-    ~inclusive_or_expression();
     void print();
-    Value* make_lvalue();
+    ConstantInt* fold();
     Value* make_rvalue();
+    Type* static_type();
 
     token op;
-    exclusive_or_expression* xe = nullptr;
-    inclusive_or_expression* lhs = nullptr;
-    exclusive_or_expression* rhs = nullptr;
+    type_name* tn;
+    expression* ce;
 };
 
-struct logical_and_expression
+enum binary_op
 {
-    ~logical_and_expression();
-    void print();
-    Value* make_rvalue();
-    Value* make_lvalue();
-
-    token op;
-    inclusive_or_expression* oe = nullptr;
-    logical_and_expression* lhs = nullptr;
-    inclusive_or_expression* rhs = nullptr;
+    BINARY_MUL, BINARY_DIV, BINARY_MOD,
+    BINARY_ADD, BINARY_SUB,
+    BINARY_SHL, BINARY_SHR,
+    BINARY_LT, BINARY_GT, BINARY_LE, BINARY_GE,
+    BINARY_EQ, BINARY_NE,
+    BINARY_AND, BINARY_XOR, BINARY_OR,
+    BINARY_LOGICAL_AND, BINARY_LOGICAL_OR
 };
 
-struct logical_or_expression
+// Any of the binary operators from * to ||, built by precedence climbing.
+struct binary_expression : expression
 {
-    ~logical_or_expression();
     void print();
-    Value* make_lvalue();
+    ConstantInt* fold();
     Value* make_rvalue();
+    Type* static_type();
 
+    binary_op kind;
     token op;
-    logical_and_expression* ae = nullptr;
-    logical_or_expression* lhs = nullptr;
-    logical_and_expression* rhs = nullptr;
+    expression* lhs;
+    expression* rhs;
 };
 
-struct conditional_expression
+struct conditional_expression : expression
 {
-    ~conditional_expression();
     void print();
-    Value* make_lvalue();
+    ConstantInt* fold();
     Value* make_rvalue();
+    Type* static_type();
 
     token op;
-    logical_or_expression* oe = nullptr;
-    logical_or_expression* expr1 = nullptr;
-    expression* expr2 = nullptr;
-    conditional_expression* expr3 = nullptr;
+    expression* expr1;
+    expression* expr2;
+    expression* expr3;
 };
 
-struct assignment_expression
+struct assignment_expression : expression
 {
-    ~assignment_expression();
     void print();
-    Value* make_lvalue();
     Value* make_rvalue();
+    Type* static_type();
 
-    conditional_expression* lhs = nullptr;
+    expression* lhs;
     token op;
-    assignment_expression* rhs = nullptr;
+    expression* rhs;
 };
 
-struct constant_expression
+struct comma_expression : expression
 {
-    ~constant_expression();
     void print();
-    Value* make_rvalue();
     Value* make_lvalue();
-
-    conditional_expression* ce;
-};
-
-struct expression
-{
-    ~expression();
-    void print();
     Value* make_rvalue();
-    Value* make_lvalue();
+    Type* static_type();
 
-    vector<assignment_expression*> ae;
+    avector<expression*> exprs;
 };
 
 struct statement
 {
-    virtual ~statement() = 0;
     virtual void codegen() = 0;
     virtual void print() = 0;
 };
 
 struct labeled_statement : statement
 {
-    virtual ~labeled_statement();
     virtual void print() = 0;
     virtual void codegen() = 0;
 
@@ -775,22 +486,24 @@ struct goto_label : labeled_statement
 
 struct case_label : labeled_statement
 {
-    ~case_label();
     void print();
     virtual void codegen();
 
-    constant_expression* ce;
+    token tok;
+    expression* ce;
+    BasicBlock *block;
 };
 
 struct default_label : labeled_statement
 {
     void print();
     virtual void codegen();
+
+    BasicBlock *block;
 };
 
 struct expression_statement : statement
 {
-    ~expression_statement();
     void print();
     virtual void codegen();
 
@@ -799,7 +512,6 @@ struct expression_statement : statement
 
 struct selection_statement : statement
 {
-    virtual ~selection_statement() = 0;
     virtual void print() = 0;
     virtual void codegen() = 0;
 
@@ -808,7 +520,6 @@ struct selection_statement : statement
 
 struct if_statement : selection_statement
 {
-    ~if_statement();
     void print();
     virtual void codegen();
 
@@ -824,11 +535,12 @@ struct switch_statement : selection_statement
 
     expression* expr;
     statement* stat;
+    avector<case_label*> cases;
+    default_label* dflt = nullptr;
 };
 
 struct iteration_statement : statement
 {
-    virtual ~iteration_statement() = 0;
     virtual void print() = 0;
     virtual void codegen() = 0;
 
@@ -837,7 +549,6 @@ struct iteration_statement : statement
 
 struct while_statement : iteration_statement
 {
-    ~while_statement();
     void print();
     virtual void codegen();
 
@@ -847,7 +558,6 @@ struct while_statement : iteration_statement
 
 struct do_while_statement : iteration_statement
 {
-    ~do_while_statement();
     void print();
     virtual void codegen();
 
@@ -857,7 +567,6 @@ struct do_while_statement : iteration_statement
 
 struct for_statement : iteration_statement
 {
-    ~for_statement();
     void print();
     virtual void codegen();
 
@@ -896,7 +605,6 @@ struct break_statement : jump_statement
 
 struct return_statement : jump_statement
 {
-    ~return_statement();
     void print();
     virtual void codegen();
 
@@ -906,14 +614,12 @@ struct return_statement : jump_statement
 
 struct block_item
 {
-    virtual ~block_item() = 0;
     virtual void print() = 0;
     virtual void codegen() = 0;
 };
 
 struct declaration_item : block_item
 {
-    ~declaration_item();
     void print();
     void codegen();
 
@@ -922,7 +628,6 @@ struct declaration_item : block_item
 
 struct statement_item : block_item
 {
-    ~statement_item();
     void print();
     void codegen();
 
@@ -931,26 +636,22 @@ struct statement_item : block_item
 
 struct compound_statement : statement
 {
-    ~compound_statement();
     void print();
     virtual void codegen();
 
-    scope* sc = nullptr;
-    vector<block_item*> bi;
+    avector<block_item*> bi;
 };
 
 struct function_definition
 {
-    ~function_definition();
     void print();
     void codegen();
 
     token get_identifier();
     void resolve_gotos();
 
-    vector<goto_statement*> gotos;
-    map<string, goto_label*> labels;
-    scope* sc;
+    avector<goto_statement*> gotos;
+    amap<symbol, goto_label*> labels;
     declaration_specifiers* ds;
     declarator* dec;
     compound_statement* cs;
@@ -958,7 +659,6 @@ struct function_definition
 
 struct external_declaration
 {
-    ~external_declaration();
     void print();
     void codegen();
 
@@ -968,19 +668,17 @@ struct external_declaration
 
 struct translation_unit
 {
-    ~translation_unit();
-    void print();
+    void print(ostream& out);
     void codegen(const char* filename);
 
     scope* sc;
-    vector<external_declaration*> ed;
+    // declared by a precompiled header before the first of ed, in order
+    avector<pair<symbol, object*>> imported;
+    avector<external_declaration*> ed;
 };
 
-object* find_var(const string& id);
-variable_object* find_variable(const string& id);
-function_object* find_function(const string& id);
-tag* find_tag(const string& id);
+object* find_var(symbol id);
+tag* find_tag(symbol id);
 Type* register_type(struct_or_union_specifier* ss);
 Type *valid_type_specifier(vector<type_specifier*> tsps);
 
-extern vector<scope*> scopes;
@@ -1,46 +1,75 @@
 #include "ast.h"
+#include "constant.h"
+#include "llvm/IR/InstIterator.h"
 #include "llvm/IR/Verifier.h"
+#include "optimize.h"
+#include "ssa.h"
 
-LLVMContext context;
-unique_ptr<Module> module;
-static unique_ptr<IRBuilder<>> builder, alloca_builder;
-static BasicBlock *continue_block = nullptr;
-static BasicBlock *break_block = nullptr;
+static AllocaInst *create_alloca(Type *type, const string &var_name)
+{
+    cu->alloca_builder->SetInsertPoint(cu->alloca_builder->GetInsertBlock(),
+                                       cu->alloca_builder->GetInsertBlock()->begin());
+    return cu->alloca_builder->CreateAlloca(type, 0, var_name.c_str());
+}
 
-extern string unescape(const string& s);
+// static symbols stay in the unit. An inline definition is only there to be
+// inlined; calls it is not inlined into go to the definition another unit
+// has. A static function never defined is left for the linker to report.
+static GlobalValue::LinkageTypes linkage(object *o)
+{
+    if (o->kind == OBJECT_FUNCTION)
+    {
+        function_object *fo = (function_object*)o;
+        if (!fo->is_defined)
+            return GlobalValue::ExternalLinkage;
+        if (!fo->internal && fo->inline_only)
+            return GlobalValue::AvailableExternallyLinkage;
+    }
+    return o->internal ? GlobalValue::InternalLinkage : GlobalValue::ExternalLinkage;
+}
 
-static AllocaInst *create_alloca(Type *type, const string &var_name)
+// Only a declaration unless the unit defines the variable; then it is zero
+// until an initializer sets it.
+static GlobalVariable *create_global(variable_object *vo, const string &var_name)
 {
-    alloca_builder->SetInsertPoint(alloca_builder->GetInsertBlock(),
-                                   alloca_builder->GetInsertBlock()->begin());
-    return alloca_builder->CreateAlloca(type, 0, var_name.c_str());
+    return new GlobalVariable(*cu->module, vo->type, false,
+                                  linkage(vo),
+                                  vo->is_defined ? Constant::getNullValue(vo->type) : nullptr,
+                                  var_name.c_str());
 }
 
-static GlobalVariable *create_global(Type *type, const string &var_name)
+static Value *create_variable(variable_object *vo, const string &var_name)
 {
-    return new GlobalVariable(*module, type, false,
-                              GlobalValue::CommonLinkage,
-                              Constant::getNullValue(type),
-                              var_name.c_str());
+    if (vo->global)
+        return create_global(vo, var_name);
+    return create_alloca(vo->type, var_name);
 }
 
-static Value *create_variable(Type *type, const string &var_name)
+// A pointer to the first character of a string literal, held in a constant
+// of its own.
+static Constant *string_constant(const token &tok)
 {
-    scope *s = scopes.back();
-    if (s->global)
-        return create_global(type, var_name);
-    return create_alloca(type, var_name);
+    string str = unescape(tok.str());
+    Constant *data = ConstantDataArray::getString(cu->context, str);
+    GlobalVariable *gv = new GlobalVariable(*cu->module, data->getType(), true,
+                                            GlobalValue::PrivateLinkage, data);
+    gv->setUnnamedAddr(GlobalValue::UnnamedAddr::Global);
+    gv->setAlignment(Align(1));
+    Constant *zero = cu->builder->getInt32(0);
+    Constant *indices[] = {zero, zero};
+    return ConstantExpr::getInBoundsGetElementPtr(data->getType(), gv, indices);
 }
 
 static Value *extend(Value *val, Type *type)
 {
     Type *vtype = val->getType();
     if (vtype->isIntegerTy(1))
-        return builder->CreateZExt(val, type);
+        return cu->builder->CreateZExt(val, type);
     else
-        return builder->CreateSExt(val, type);
+        return cu->builder->CreateSExt(val, type);
 }
 
+// Converts val to type, before the terminator of block if one is given.
 static Value *cast(Value *val, Type *type, BasicBlock *block = nullptr)
 {
     Type *vtype = val->getType();
@@ -49,38 +78,121 @@ static Value *cast(Value *val, Type *type, BasicBlock *block = nullptr)
 
     if (type->isPointerTy() && vtype->isPointerTy())
     {
-        if (block) builder->SetInsertPoint(block);
-        return builder->CreateBitCast(val, type);
+        if (block) cu->builder->SetInsertPoint(block->getTerminator());
+        return cu->builder->CreateBitCast(val, type);
     }
 
     if (type->isPointerTy())
     {
-        if (block) builder->SetInsertPoint(block);
-        return builder->CreateIntToPtr(val, type);
+        if (block) cu->builder->SetInsertPoint(block->getTerminator());
+        return cu->builder->CreateIntToPtr(val, type);
     }
 
     if (vtype->isPointerTy())
     {
-        if (block) builder->SetInsertPoint(block);
-        return builder->CreatePtrToInt(val, type);
+        if (block) cu->builder->SetInsertPoint(block->getTerminator());
+        return cu->builder->CreatePtrToInt(val, type);
     }
 
     if (vtype->isIntegerTy() && type->isIntegerTy())
     {
-        if (block) builder->SetInsertPoint(block);
+        if (block) cu->builder->SetInsertPoint(block->getTerminator());
         if (vtype->getPrimitiveSizeInBits() < type->getPrimitiveSizeInBits())
             return extend(val, type);
-        return builder->CreateSExtOrTrunc(val, type);
+        return cu->builder->CreateSExtOrTrunc(val, type);
     }
     return nullptr;
 }
 
-static Value *store(Value *val, Value *ptr)
+// Sealed once every predecessor of block has been emitted.
+static void seal(BasicBlock *block)
 {
-    val = cast(val, ptr->getType()->getContainedType(0));
-    if (!val)
-        return nullptr;
-    return builder->CreateStore(val, ptr);
+    cu->ssa->seal(block);
+}
+
+// Code following a jump is unreachable; it still needs a block to go into.
+static void start_dead_block()
+{
+    BasicBlock *dead_block = BasicBlock::Create(
+        cu->context,
+        "DEAD_BLOCK",
+        cu->builder->GetInsertBlock()->getParent(),
+        0);
+
+    cu->builder->SetInsertPoint(dead_block);
+    seal(dead_block);
+}
+
+// A scalar local whose address is never taken is kept in SSA values, with no
+// storage of its own.
+static bool in_registers(variable_object *vo)
+{
+    if (vo->global || vo->address_taken)
+        return false;
+    Type *type = vo->type;
+    return type->isIntegerTy() || type->isPointerTy() || type->isFloatingPointTy();
+}
+
+// What an assignment or increment writes to: an address, or a local kept in
+// SSA values.
+struct target
+{
+    Value *address;
+    variable_object *local;
+
+    Value *load() const
+    {
+        if (local)
+            return cu->ssa->read(local, cu->builder->GetInsertBlock());
+        Value *ptr = address;
+        return cu->builder->CreateLoad(ptr);
+    }
+
+    // nullptr if val does not convert to the type of the target
+    Value *store(Value *val) const
+    {
+        Type *type = local ? local->type : address->getType()->getContainedType(0);
+        val = cast(val, type);
+        if (!val)
+            return nullptr;
+        if (local)
+        {
+            cu->ssa->write(local, cu->builder->GetInsertBlock(), val);
+            return val;
+        }
+        return cu->builder->CreateStore(val, address);
+    }
+};
+
+static target variable_target(variable_object *vo)
+{
+    if (vo->store)
+        return {vo->store, nullptr};
+    return {nullptr, vo};
+}
+
+// Evaluates every operand of ce but the last, for its side effects only.
+static void evaluate_leading(comma_expression *ce)
+{
+    for (size_t i = 0; i + 1 < ce->exprs.size(); ++i)
+        ce->exprs[i]->make_rvalue();
+}
+
+static target make_target(expression *e, const token &op)
+{
+    if (comma_expression *ce = dynamic_cast<comma_expression*>(e))
+    {
+        evaluate_leading(ce);
+        return make_target(ce->exprs.back(), op);
+    }
+    primary_expression *pe = dynamic_cast<primary_expression*>(e);
+    if (pe && pe->tok.type == IDENTIFIER && pe->var->kind == OBJECT_VARIABLE)
+        return variable_target((variable_object*)pe->var);
+
+    Value *address = e->make_lvalue();
+    if (!address)
+        error::reject(op);
+    return {address, nullptr};
 }
 
 static bool adjust_int(Value *&lhs, Value *&rhs, BasicBlock *lblock = nullptr, BasicBlock *rblock = nullptr)
@@ -93,12 +205,12 @@ static bool adjust_int(Value *&lhs, Value *&rhs, BasicBlock *lblock = nullptr, B
 
     if (rtype->getPrimitiveSizeInBits() > ltype->getPrimitiveSizeInBits())
     {
-        if (lblock) builder->SetInsertPoint(lblock);
+        if (lblock) cu->builder->SetInsertPoint(lblock->getTerminator());
         lhs = extend(lhs, rhs->getType());
     }
     if (rtype->getPrimitiveSizeInBits() < ltype->getPrimitiveSizeInBits())
     {
-        if (rblock) builder->SetInsertPoint(rblock);
+        if (rblock) cu->builder->SetInsertPoint(rblock->getTerminator());
         rhs = extend(rhs, lhs->getType());
     }
     return true;
@@ -115,9 +227,9 @@ static bool adjust_ptr(Value *&lhs, Value *&rhs)
     if (ltype != rtype)
         return false;
 
-    Type *type = Type::getInt64Ty(context);
-    lhs = builder->CreatePtrToInt(lhs, type);
-    rhs = builder->CreatePtrToInt(rhs, type);
+    Type *type = Type::getInt64Ty(cu->context);
+    lhs = cu->builder->CreatePtrToInt(lhs, type);
+    rhs = cu->builder->CreatePtrToInt(rhs, type);
     return true;
 }
 
@@ -167,26 +279,26 @@ static Value *truncate(Value* cond)
         return cond;
 
     if (type->isPointerTy())
-        cond = builder->CreatePtrToInt(cond, Type::getInt64Ty(context));
+        cond = cu->builder->CreatePtrToInt(cond, Type::getInt64Ty(cu->context));
 
-    Value *zero = builder->getInt64(0);
+    Value *zero = cu->builder->getInt64(0);
     if (!adjust_int_ptr(cond, zero))
         return nullptr;
 
-    return builder->CreateICmpNE(cond, zero);
+    return cu->builder->CreateICmpNE(cond, zero);
 }
 
 static Value *create_gep(Value *ptr, Value *idx)
 {
-    idx = cast(idx, Type::getInt32Ty(context));
-    return builder->CreateGEP(ptr, idx);
+    idx = cast(idx, Type::getInt32Ty(cu->context));
+    return cu->builder->CreateGEP(ptr, idx);
 }
 
 static Value *negative(Value *val)
 {
     if (!val->getType()->isIntegerTy())
         return nullptr;
-    return builder->CreateSub(ConstantInt::get(val->getType(), 0), val);
+    return cu->builder->CreateSub(ConstantInt::get(val->getType(), 0), val);
 }
 
 static Value *create_add(Value *lhs, Value *rhs)
@@ -209,7 +321,7 @@ static Value *create_add(Value *lhs, Value *rhs)
     if (!adjust_int(rhs, lhs))
         return nullptr;
 
-    return builder->CreateAdd(lhs, rhs);
+    return cu->builder->CreateAdd(lhs, rhs);
 }
 
 static Value *create_div(Value *lhs, Value *rhs)
@@ -217,7 +329,7 @@ static Value *create_div(Value *lhs, Value *rhs)
     if (!adjust_int(lhs, rhs))
         return nullptr;
 
-    return builder->CreateSDiv(lhs, rhs);
+    return cu->builder->CreateSDiv(lhs, rhs);
 }
 
 static Value *create_rem(Value *lhs, Value *rhs)
@@ -225,7 +337,7 @@ static Value *create_rem(Value *lhs, Value *rhs)
     if (!adjust_int(lhs, rhs))
         return nullptr;
 
-    return builder->CreateSRem(lhs, rhs);
+    return cu->builder->CreateSRem(lhs, rhs);
 }
 
 static Value *get_size(Type *type)
@@ -246,10 +358,10 @@ static Value *create_sub(Value *lhs, Value *rhs)
         if (rtype->getContainedType(0) != ltype->getContainedType(0))
             return nullptr;
 
-        Type *type = Type::getInt32Ty(context);
-        lhs = builder->CreatePtrToInt(lhs, type);
-        rhs = builder->CreatePtrToInt(rhs, type);
-        Value *diff = builder->CreateSub(lhs, rhs);
+        Type *type = Type::getInt32Ty(cu->context);
+        lhs = cu->builder->CreatePtrToInt(lhs, type);
+        rhs = cu->builder->CreatePtrToInt(rhs, type);
+        Value *diff = cu->builder->CreateSub(lhs, rhs);
         return create_div(diff, get_size(rtype->getContainedType(0)));
     }
 
@@ -262,7 +374,7 @@ static Value *create_sub(Value *lhs, Value *rhs)
     if (!adjust_int(lhs, rhs))
         return nullptr;
 
-    return builder->CreateSub(lhs, rhs);
+    return cu->builder->CreateSub(lhs, rhs);
 }
 
 static Value *create_mul(Value *lhs, Value *rhs)
@@ -270,106 +382,171 @@ static Value *create_mul(Value *lhs, Value *rhs)
     if (!adjust_int(lhs, rhs))
         return nullptr;
 
-    return builder->CreateMul(lhs, rhs);
+    return cu->builder->CreateMul(lhs, rhs);
 }
 
-Value* declarator::codegen()
+// The storage of a variable, or the function, that o declares as identifier,
+// made by its first declaration; nullptr for a variable kept in registers.
+static Value* declare(object* o, const string& identifier)
 {
-    string identifier = get_identifier().str;
-    if (dd->is_identifier() || dd->is_definition())
+    if (o->kind == OBJECT_VARIABLE)
     {
-        variable_object* vo = find_variable(identifier);
-        if (vo->type->isVoidTy())
-            error::reject(get_identifier());
-        if (vo->type->isStructTy() && ((StructType*)vo->type)->isOpaque())
-            error::reject(get_identifier());
-        vo->store = create_variable(vo->type, identifier);
+        variable_object* vo = (variable_object*)o;
+        if (in_registers(vo))
+            return nullptr;
+        if (!vo->store)
+            vo->store = create_variable(vo, identifier);
         return vo->store;
     }
-    else
+
+    function_object* fo = (function_object*)o;
+    if (!fo->function)
     {
-        function_object* fo = find_function(identifier);
-        if (!fo->function)
-        {
-            fo->function = Function::Create(
-                fo->type,
-                GlobalValue::ExternalLinkage,
-                identifier.c_str(),
-                *module);
-        }
-        return fo->function;
+        fo->function = Function::Create(
+            fo->type,
+            linkage(fo),
+            identifier.c_str(),
+            *cu->module);
     }
+    return fo->function;
 }
 
-void declaration::codegen()
+Value* declarator::codegen()
 {
-    for (declarator* de : d)
-        de->codegen();
+    token tok = get_identifier();
+    string identifier(tok.str());
+    if (obj->kind == OBJECT_VARIABLE)
+    {
+        variable_object* vo = (variable_object*)obj;
+        Type* type = vo->type;
+        if (type->isVoidTy())
+            error::reject(tok);
+        if (type->isStructTy() && ((StructType*)type)->isOpaque())
+            error::reject(tok);
+
+        // a static local is named after the function it is in, apart from
+        // the symbols of the file; cu->ssa is only set in a function body
+        if (vo->global && vo->internal && cu->ssa)
+            identifier = cu->builder->GetInsertBlock()->getParent()->getName().str()
+                + "." + identifier;
+    }
+    return declare(obj, identifier);
 }
 
-Value* primary_expression::make_lvalue()
+// The constant an expression in the initializer of a variable of static
+// storage stands for: an integer constant, or a string literal, a function
+// or the address of a variable of static storage, possibly cast to another
+// pointer. nullptr for anything else.
+static Constant *constant_value(expression *e)
 {
-    if (tok.type == IDENTIFIER)
+    if (e->value)
+        return e->value;
+    if (cast_expression *ce = dynamic_cast<cast_expression*>(e))
     {
-        variable_object* vo = find_variable(tok.str);
-        if (!vo)
+        Constant *c = constant_value(ce->ce);
+        if (!c || !ce->tn->type->isPointerTy())
             return nullptr;
-        return vo->store;
+        return dyn_cast_or_null<Constant>(cast(c, ce->tn->type));
+    }
+    if (unary_expression *ue = dynamic_cast<unary_expression*>(e))
+    {
+        primary_expression *pe = dynamic_cast<primary_expression*>(ue->operand);
+        if (ue->kind != UNARY_ADDRESS || !pe || !pe->var
+            || pe->var->kind != OBJECT_VARIABLE || !((variable_object*)pe->var)->global)
+            return nullptr;
+        return (Constant*)((variable_object*)pe->var)->store;
     }
+
+    primary_expression *pe = dynamic_cast<primary_expression*>(e);
+    if (pe && pe->tok.type == STRING_LITERAL)
+        return string_constant(pe->tok);
+    if (pe && pe->var && pe->var->kind == OBJECT_FUNCTION)
+        return ((function_object*)pe->var)->function;
     return nullptr;
 }
 
-Value* primary_expression::make_rvalue()
+// The value in gives an object of type. With constant, as for static
+// storage, each expression in it must have a constant_value and no code is
+// emitted.
+static Value *initial_value(initializer *in, Type *type, bool constant)
 {
-    if (tok.type == IDENTIFIER)
+    if (in->expr)
     {
-        if (variable_object* vo = find_variable(tok.str))
-            return builder->CreateLoad(vo->store);
-        if (function_object* fo = find_function(tok.str))
-            return fo->function;
-        error::reject(tok);
+        Value *val = constant ? constant_value(in->expr) : in->expr->make_rvalue();
+        if (val)
+            val = cast(val, type);
+        if (!val)
+            error::reject(in->tok);
+        return val;
     }
-    else if (tok.type == CONSTANT)
+
+    // braces around a scalar hold just it
+    StructType *st = dyn_cast<StructType>(type);
+    if (!st)
     {
-        if (tok.str[0] == '\'')
-        {
-            int val = tok.str[1];
-            return ConstantInt::get(context, APInt(8, val, true));
-        }
-        else
-        {
-            int val = stoi(tok.str);
-            return ConstantInt::get(context, APInt(32, val, true));
-        }
+        if (in->list.size() != 1 || !in->list[0]->expr)
+            error::reject(in->tok);
+        return initial_value(in->list[0], type, constant);
     }
-    else if (tok.type == STRING_LITERAL)
+    if (in->list.size() > st->getNumElements())
+        error::reject(in->list[st->getNumElements()]->tok);
+
+    // members left out are zero
+    Value *val = Constant::getNullValue(st);
+    for (unsigned i = 0; i < in->list.size(); ++i)
     {
-        string str = unescape(tok.str);
-        return builder->CreateGlobalStringPtr(StringRef(str.c_str(), str.size()));
+        Value *member = initial_value(in->list[i], st->getElementType(i), constant);
+        val = cu->builder->CreateInsertValue(val, member, i);
     }
-    error::reject(tok);
+    return val;
 }
 
-Value* parenthesized_expression::make_rvalue()
+void declaration::codegen()
 {
-    return expr->make_rvalue();
+    for (declarator* de : d)
+    {
+        de->codegen();
+        if (!de->init)
+            continue;
+
+        variable_object* vo = (variable_object*)de->obj;
+        if (vo->global)
+        {
+            Constant *val = (Constant*)initial_value(de->init, vo->type, true);
+            ((GlobalVariable*)vo->store)->setInitializer(val);
+        }
+        else
+            variable_target(vo).store(initial_value(de->init, vo->type, false));
+    }
 }
 
-Value* parenthesized_expression::make_lvalue()
+Value* expression::make_lvalue()
 {
-    return expr->make_lvalue();
+    return nullptr;
 }
 
-Value* postfix_expression::make_rvalue()
+Value* primary_expression::make_lvalue()
 {
-    return pe->make_rvalue();
+    if (tok.type == IDENTIFIER && var->kind == OBJECT_VARIABLE)
+        return ((variable_object*)var)->store;
+    return nullptr;
 }
 
-Value* postfix_expression::make_lvalue()
+Value* primary_expression::make_rvalue()
 {
-    if (pe)
-        return pe->make_lvalue();
-    return nullptr;
+    if (tok.type == IDENTIFIER)
+    {
+        if (var->kind == OBJECT_VARIABLE)
+        {
+            return variable_target((variable_object*)var).load();
+        }
+        return ((function_object*)var)->function;
+    }
+    else if (tok.type == CONSTANT && value)
+        return value;
+    else if (tok.type == STRING_LITERAL)
+        return string_constant(tok);
+    error::reject(tok);
 }
 
 Value* subscript_expression::make_rvalue()
@@ -377,7 +554,7 @@ Value* subscript_expression::make_rvalue()
     Value *ptr = make_lvalue();
     if (!ptr)
         error::reject(op);
-    return builder->CreateLoad(ptr);
+    return cu->builder->CreateLoad(ptr);
 }
 
 Value* subscript_expression::make_lvalue()
@@ -417,33 +594,26 @@ Value* call_expression::make_rvalue()
             error::reject(opop);
     }
 
-    return builder->CreateCall(ftype, lhs, cargs);
-}
-
-// TODO: forbid this nonsense
-Value* call_expression::make_lvalue()
-{
-    Value *val = make_rvalue();
-    Value *alloca = create_alloca(val->getType(), "tmp");
-    store(val, alloca);
-    return alloca;
+    return cu->builder->CreateCall(ftype, lhs, cargs);
 }
 
-Value* dot_expression::make_rvalue()
+// Index of the member id of a struct of type stype.
+static unsigned member_index(StructType* stype, const token& id)
 {
-    Value *ptr = make_lvalue();
-    if (!ptr)
-        error::reject(op);
-    return builder->CreateLoad(ptr);
+    // a struct type that no tag made has no member names to look up
+    tag *t = cu->struct_tags.lookup(stype);
+    if (!t)
+        error::reject(id);
+    auto it = t->indices.find(id.sym);
+    if (it == t->indices.end())
+        error::reject(id);
+    return it->second;
 }
 
-Value* dot_expression::make_lvalue()
+// Address of the member id of the struct that ptr points to.
+static Value* member_address(Value* ptr, const token& op, const token& id)
 {
-    Value *l = pfe->make_lvalue();
-    if (!l)
-        error::reject(op);
-
-    Type *type = l->getType();
+    Type *type = ptr->getType();
     if (type->getNumContainedTypes() != 1)
         error::reject(op);
 
@@ -452,821 +622,509 @@ Value* dot_expression::make_lvalue()
         error::reject(op);
 
     StructType *stype = (StructType*)type;
-    extern map<string, tag*> htags;
-    tag *t = htags[stype->getName().str()];
-    auto it = t->indices.find(id.str);
-    if (it == t->indices.end())
-        error::reject(id);
+    return cu->builder->CreateStructGEP(stype, ptr, member_index(stype, id));
+}
 
-    vector<Value*> indices;
-    indices.push_back(builder->getInt32(0));
-    indices.push_back(builder->getInt32(it->second));
-    return builder->CreateInBoundsGEP(l, indices);
+// A struct value with no address, such as one a call returns.
+static bool is_temporary(expression* e)
+{
+    if (dynamic_cast<call_expression*>(e) || dynamic_cast<conditional_expression*>(e))
+        return true;
+    if (dot_expression* de = dynamic_cast<dot_expression*>(e))
+        return is_temporary(de->pfe);
+    return false;
 }
 
-Value* arrow_expression::make_rvalue()
+Value* dot_expression::make_rvalue()
 {
+    if (is_temporary(pfe))
+    {
+        Value *val = pfe->make_rvalue();
+        if (!val->getType()->isStructTy())
+            error::reject(op);
+        return cu->builder->CreateExtractValue(val, member_index((StructType*)val->getType(), id));
+    }
     Value *ptr = make_lvalue();
     if (!ptr)
         error::reject(op);
-    return builder->CreateLoad(ptr);
+    return cu->builder->CreateLoad(ptr);
 }
 
-Value* arrow_expression::make_lvalue()
+Value* dot_expression::make_lvalue()
 {
-    Value *l = pfe->make_rvalue();
-    Type *type = l->getType();
-    if (type->getNumContainedTypes() != 1)
+    Value *l = pfe->make_lvalue();
+    if (!l)
         error::reject(op);
+    return member_address(l, op, id);
+}
 
-    type = type->getContainedType(0);
-    if (!type->isStructTy())
+Value* arrow_expression::make_rvalue()
+{
+    Value *ptr = make_lvalue();
+    if (!ptr)
         error::reject(op);
+    return cu->builder->CreateLoad(ptr);
+}
 
-    StructType *stype = (StructType*)type;
-    extern map<string, tag*> htags;
-    tag *t = htags[stype->getName().str()];
-    auto it = t->indices.find(id.str);
-    if (it == t->indices.end())
-        error::reject(id);
-
-    vector<Value*> indices;
-    indices.push_back(builder->getInt32(0));
-    indices.push_back(builder->getInt32(it->second));
-    return builder->CreateInBoundsGEP(l, indices);
+Value* arrow_expression::make_lvalue()
+{
+    return member_address(pfe->make_rvalue(), op, id);
 }
 
 Value* postfix_increment_expression::make_rvalue()
 {
-    Value *addr = pfe->make_lvalue();
-    if (!addr)
-        error::reject(op);
-    Value *oval = builder->CreateLoad(addr);
-    Value *nval = create_add(oval, ConstantInt::get(Type::getInt32Ty(context), 1));
+    target t = make_target(pfe, op);
+    Value *oval = t.load();
+    Value *nval = create_add(oval, ConstantInt::get(Type::getInt32Ty(cu->context), 1));
     if (!nval)
         error::reject(op);
-    store(nval, addr);
+    t.store(nval);
     return oval;
 }
 
-Value* postfix_increment_expression::make_lvalue()
-{
-    return nullptr;
-}
-
 Value* postfix_decrement_expression::make_rvalue()
 {
-    Value *addr = pfe->make_lvalue();
-    if (!addr)
-        error::reject(op);
-    Value *oval = builder->CreateLoad(addr);
-    Value *nval = create_sub(oval, ConstantInt::get(Type::getInt32Ty(context), 1));
+    target t = make_target(pfe, op);
+    Value *oval = t.load();
+    Value *nval = create_sub(oval, ConstantInt::get(Type::getInt32Ty(cu->context), 1));
     if (!nval)
         error::reject(op);
-    store(nval, addr);
+    t.store(nval);
     return oval;
 }
 
-Value* postfix_decrement_expression::make_lvalue()
-{
-    return nullptr;
-}
-
 Value* unary_expression::make_rvalue()
 {
-    return pe->make_rvalue();
+    if (value)
+        return value;
+    switch (kind)
+    {
+    case UNARY_INCREMENT:
+    case UNARY_DECREMENT:
+    {
+        target t = make_target(operand, op);
+        Value *oval = t.load();
+        Value *one = ConstantInt::get(Type::getInt32Ty(cu->context), 1);
+        Value *nval = kind == UNARY_INCREMENT ? create_add(oval, one) : create_sub(oval, one);
+        if (!nval)
+            error::reject(op);
+        t.store(nval);
+        return t.load();
+    }
+    case UNARY_ADDRESS:
+    {
+        Value *val = operand->make_lvalue();
+        if (!val)
+            error::reject(op);
+        return val;
+    }
+    case UNARY_DEREFERENCE:
+    {
+        Value *addr = operand->make_rvalue();
+        Type *type = addr->getType();
+        if (!type->isPointerTy())
+            error::reject(op);
+        if (type->getContainedType(0)->isFunctionTy())
+            return addr;
+        return cu->builder->CreateLoad(addr);
+    }
+    case UNARY_PLUS:
+        return operand->make_rvalue();
+    case UNARY_MINUS:
+    {
+        Value* r = negative(operand->make_rvalue());
+        if (!r)
+            error::reject(op);
+        return r;
+    }
+    case UNARY_COMPLEMENT:
+    {
+        Value* r = operand->make_rvalue();
+        return cu->builder->CreateXor(ConstantInt::get(r->getType(), -1), r);
+    }
+    case UNARY_NOT:
+    {
+        Value* r = operand->make_rvalue();
+        Value *zero = cu->builder->getInt32(0);
+        r = cast(r, zero->getType());
+        if (!r)
+            error::reject(op);
+        return cu->builder->CreateICmpEQ(r, zero);
+    }
+    }
+    error::reject(op);
 }
 
 Value* unary_expression::make_lvalue()
 {
-    return pe->make_lvalue();
+    if (kind == UNARY_DEREFERENCE)
+        return operand->make_rvalue();
+    return nullptr;
 }
 
-Value* prefix_increment_expression::make_rvalue()
+Value* sizeof_expression::make_rvalue()
 {
-    Value *addr = ue->make_lvalue();
-    if (!addr)
+    if (value)
+        return value;
+    // the operand is only typed, never evaluated
+    Type *type = ue->static_type();
+    if (!type || !type->isSized())
         error::reject(op);
-    Value *oval = builder->CreateLoad(addr);
-    Value *nval = create_add(oval, ConstantInt::get(Type::getInt32Ty(context), 1));
-    if (!nval)
-        error::reject(op);
-    store(nval, addr);
-    return builder->CreateLoad(addr);
+    return get_size(type);
 }
 
-Value* prefix_increment_expression::make_lvalue()
+Value* sizeof_type_expression::make_rvalue()
 {
-    return nullptr;
+    if (value)
+        return value;
+    return get_size(tn->type);
 }
 
-Value* prefix_decrement_expression::make_rvalue()
+Value* cast_expression::make_rvalue()
 {
-    Value *addr = ue->make_lvalue();
-    if (!addr)
-        error::reject(op);
-    Value *oval = builder->CreateLoad(addr);
-    Value *nval = create_sub(oval, ConstantInt::get(Type::getInt32Ty(context), 1));
-    if (!nval)
+    if (value)
+        return value;
+    Value *v = cast(ce->make_rvalue(), tn->type);
+    if (!v)
         error::reject(op);
-    store(nval, addr);
-    return builder->CreateLoad(addr);
+    return v;
 }
 
-Value* prefix_decrement_expression::make_lvalue()
+static Value* create_logical_and(binary_expression* be)
 {
-    return nullptr;
-}
+    Function *function = cu->builder->GetInsertBlock()->getParent();
 
-Value* unary_and_expression::make_rvalue()
-{
-    Value *val = ce->make_lvalue();
-    if (!val)
-        error::reject(op);
-    return val;
-}
+    BasicBlock *header_block = BasicBlock::Create(cu->context, "and-header", function);
+    cu->builder->CreateBr(header_block);
+    cu->builder->SetInsertPoint(header_block);
+    seal(header_block);
+    Value *cond = truncate(be->lhs->make_rvalue());
+    if (!cond)
+        error::reject(be->op);
 
-Value* unary_and_expression::make_lvalue()
-{
-    return nullptr;
-}
+    BasicBlock *true_block = BasicBlock::Create(cu->context, "true", function);
+    BasicBlock *false_block = BasicBlock::Create(cu->context, "false", function);
+    BasicBlock *ttrue_block = BasicBlock::Create(cu->context, "ttrue", function);
+    BasicBlock *merge_block = BasicBlock::Create(cu->context, "merge", function);
 
-Value* unary_star_expression::make_rvalue()
-{
-    Value *addr = ce->make_rvalue();
-    Type *type = addr->getType();
-    if (!type->isPointerTy())
-        error::reject(op);
-    if (type->getContainedType(0)->isFunctionTy())
-        return addr;
-    return builder->CreateLoad(addr);
-}
+    cu->builder->CreateCondBr(cond, true_block, false_block);
 
-Value* unary_star_expression::make_lvalue()
-{
-    return ce->make_rvalue();
+    cu->builder->SetInsertPoint(true_block);
+    seal(true_block);
+    Value *tcond = truncate(be->rhs->make_rvalue());
+    if (!tcond)
+        error::reject(be->op);
+    cu->builder->CreateCondBr(tcond, ttrue_block, false_block);
+
+    cu->builder->SetInsertPoint(ttrue_block);
+    seal(ttrue_block);
+    Value *tval = cu->builder->getInt1(1);
+    cu->builder->CreateBr(merge_block);
+    cu->builder->SetInsertPoint(false_block);
+    seal(false_block);
+    Value *fval = cu->builder->getInt1(0);
+    cu->builder->CreateBr(merge_block);
+    cu->builder->SetInsertPoint(merge_block);
+    seal(merge_block);
+
+    PHINode *pn = cu->builder->CreatePHI(Type::getInt1Ty(cu->context), 2, "phi");
+    pn->addIncoming(tval, ttrue_block);
+    pn->addIncoming(fval, false_block);
+    return pn;
 }
 
-Value* unary_plus_expression::make_rvalue()
+static Value* create_logical_or(binary_expression* be)
 {
-    return ce->make_rvalue();
-}
+    Function *function = cu->builder->GetInsertBlock()->getParent();
 
-Value* unary_plus_expression::make_lvalue()
-{
-    return nullptr;
-}
+    BasicBlock *header_block = BasicBlock::Create(cu->context, "or-header", function);
+    cu->builder->CreateBr(header_block);
+    cu->builder->SetInsertPoint(header_block);
+    seal(header_block);
+    Value *cond = truncate(be->lhs->make_rvalue());
+    if (!cond)
+        error::reject(be->op);
 
-Value* unary_minus_expression::make_rvalue()
-{
-    Value* r = negative(ce->make_rvalue());
-    if (!r)
-        error::reject(op);
-    return r;
-}
+    BasicBlock *true_block = BasicBlock::Create(cu->context, "true", function);
+    BasicBlock *false_block = BasicBlock::Create(cu->context, "false", function);
+    BasicBlock *ffalse_block = BasicBlock::Create(cu->context, "ffalse", function);
+    BasicBlock *merge_block = BasicBlock::Create(cu->context, "merge", function);
 
-Value* unary_minus_expression::make_lvalue()
-{
-    return nullptr;
-}
+    cu->builder->CreateCondBr(cond, true_block, false_block);
 
-Value* unary_tilde_expression::make_rvalue()
-{
-    Value* r = ce->make_rvalue();
-    return builder->CreateXor(ConstantInt::get(r->getType(), -1), r);
+    cu->builder->SetInsertPoint(false_block);
+    seal(false_block);
+    Value *fcond = truncate(be->rhs->make_rvalue());
+    if (!fcond)
+        error::reject(be->op);
+    cu->builder->CreateCondBr(fcond, true_block, ffalse_block);
+
+    cu->builder->SetInsertPoint(true_block);
+    seal(true_block);
+    Value *tval = cu->builder->getInt1(1);
+    cu->builder->CreateBr(merge_block);
+    cu->builder->SetInsertPoint(ffalse_block);
+    seal(ffalse_block);
+    Value *fval = cu->builder->getInt1(0);
+    cu->builder->CreateBr(merge_block);
+    cu->builder->SetInsertPoint(merge_block);
+    seal(merge_block);
+
+    PHINode *pn = cu->builder->CreatePHI(Type::getInt1Ty(cu->context), 2, "phi");
+    pn->addIncoming(tval, true_block);
+    pn->addIncoming(fval, ffalse_block);
+    return pn;
 }
 
-Value* unary_tilde_expression::make_lvalue()
+Value* binary_expression::make_rvalue()
 {
-    return nullptr;
-}
+    if (value)
+        return value;
+    if (kind == BINARY_LOGICAL_AND)
+        return create_logical_and(this);
+    if (kind == BINARY_LOGICAL_OR)
+        return create_logical_or(this);
 
-Value* unary_not_expression::make_rvalue()
-{
-    Value* r = ce->make_rvalue();
-    Value *zero = builder->getInt32(0);
-    r = cast(r, zero->getType());
-    if (!r)
+    Value* l = lhs->make_rvalue();
+    Value* r = rhs->make_rvalue();
+    Value* v = nullptr;
+    switch (kind)
+    {
+    case BINARY_MUL:
+        v = create_mul(l, r);
+        break;
+    case BINARY_DIV:
+        v = create_div(l, r);
+        break;
+    case BINARY_MOD:
+        v = create_rem(l, r);
+        break;
+    case BINARY_ADD:
+        v = create_add(l, r);
+        break;
+    case BINARY_SUB:
+        v = create_sub(l, r);
+        break;
+    case BINARY_SHL:
+        v = cu->builder->CreateShl(l, r);
+        break;
+    case BINARY_SHR:
+        v = cu->builder->CreateAShr(l, r);
+        break;
+    case BINARY_LT:
+        if (adjust_int_ptr(l, r))
+            v = cu->builder->CreateICmpSLT(l, r);
+        break;
+    case BINARY_GT:
+        if (adjust_int_ptr(l, r))
+            v = cu->builder->CreateICmpSGT(l, r);
+        break;
+    case BINARY_LE:
+        if (adjust_int_ptr(l, r))
+            v = cu->builder->CreateICmpSLE(l, r);
+        break;
+    case BINARY_GE:
+        if (adjust_int_ptr(l, r))
+            v = cu->builder->CreateICmpSGE(l, r);
+        break;
+    case BINARY_EQ:
+        if (adjust_int_ptr(l, r))
+            v = cu->builder->CreateICmpEQ(l, r);
+        break;
+    case BINARY_NE:
+        if (adjust_int_ptr(l, r))
+            v = cu->builder->CreateICmpNE(l, r);
+        break;
+    case BINARY_AND:
+        if (adjust_int(l, r))
+            v = cu->builder->CreateAnd(l, r);
+        break;
+    case BINARY_XOR:
+        if (adjust_int(l, r))
+            v = cu->builder->CreateXor(l, r);
+        break;
+    case BINARY_OR:
+        if (adjust_int(l, r))
+            v = cu->builder->CreateOr(l, r);
+        break;
+    default:
+        break;
+    }
+    if (!v)
         error::reject(op);
-    return builder->CreateICmpEQ(r, zero);
+    return v;
 }
 
-Value* unary_not_expression::make_lvalue()
+Value* conditional_expression::make_rvalue()
 {
-    return nullptr;
-}
+    if (value)
+        return value;
+    Function *function = cu->builder->GetInsertBlock()->getParent();
 
-Value* sizeof_expression::make_rvalue()
-{
-    Value *val = ue->make_rvalue();
-    return get_size(val->getType());
-}
+    BasicBlock *header_block = BasicBlock::Create(cu->context, "cond-header", function);
+    BasicBlock *true_block = BasicBlock::Create(cu->context, "true", function);
+    BasicBlock *false_block = BasicBlock::Create(cu->context, "false", function);
+    BasicBlock *end_block = BasicBlock::Create(cu->context, "end", function);
 
-Value* sizeof_expression::make_lvalue()
-{
-    return nullptr;
-}
+    cu->builder->CreateBr(header_block);
 
-Value* sizeof_type_expression::make_rvalue()
-{
-    return get_size(tn->type);
-}
+    cu->builder->SetInsertPoint(header_block);
+    seal(header_block);
+    Value *cond = truncate(expr1->make_rvalue());
+    if (!cond)
+        error::reject(op);
+    cu->builder->CreateCondBr(cond, true_block, false_block);
 
-Value* sizeof_type_expression::make_lvalue()
-{
-    return nullptr;
-}
-
-Value* cast_expression::make_rvalue()
-{
-    if (ue)
-        return ue->make_rvalue();
-
-    Value *v = cast(ce->make_rvalue(), tn->type);
-    if (!v)
-        error::reject(op);
-    return v;
-}
-
-Value* cast_expression::make_lvalue()
-{
-    if (ue)
-        return ue->make_lvalue();
-    return nullptr;
-}
-
-Value* multiplicative_expression::make_rvalue()
-{
-    return ce->make_rvalue();
-}
-
-Value* multiplicative_expression::make_lvalue()
-{
-    return ce->make_lvalue();
-}
-
-Value* mul_expression::make_rvalue()
-{
-    Value* l = lhs->make_rvalue();
-    Value* r = rhs->make_rvalue();
-    Value *v = create_mul(l, r);
-    if (!v)
-        error::reject(op);
-    return v;
-}
-
-Value* mul_expression::make_lvalue()
-{
-    return nullptr;
-}
-
-Value* div_expression::make_rvalue()
-{
-    Value* l = lhs->make_rvalue();
-    Value* r = rhs->make_rvalue();
-    Value *d = create_div(l, r);
-    if (!d)
-        error::reject(op);
-    return d;
-}
-
-Value* div_expression::make_lvalue()
-{
-    return nullptr;
-}
-
-Value* mod_expression::make_rvalue()
-{
-    Value* l = lhs->make_rvalue();
-    Value* r = rhs->make_rvalue();
-    Value *v = create_rem(l, r);
-    if (!v)
-        error::reject(op);
-    return v;
-}
-
-Value* mod_expression::make_lvalue()
-{
-    return nullptr;
-}
-
-Value* additive_expression::make_rvalue()
-{
-    return me->make_rvalue();
-}
-
-Value* additive_expression::make_lvalue()
-{
-    return me->make_lvalue();
-}
-
-Value* add_expression::make_rvalue()
-{
-    Value* l = lhs->make_rvalue();
-    Value* r = rhs->make_rvalue();
-    Value *v = create_add(l, r);
-    if (!v)
-        error::reject(op);
-    return v;
-}
-
-Value* add_expression::make_lvalue()
-{
-    return nullptr;
-}
-
-Value* sub_expression::make_rvalue()
-{
-    Value* l = lhs->make_rvalue();
-    Value* r = rhs->make_rvalue();
-    Value *v =create_sub(l, r);
-    if (!v)
-        error::reject(op);
-    return v;
-}
-
-Value* sub_expression::make_lvalue()
-{
-    return nullptr;
-}
-
-Value* shift_expression::make_rvalue()
-{
-    return ae->make_rvalue();
-}
-
-Value* shift_expression::make_lvalue()
-{
-    return ae->make_lvalue();
-}
-
-Value* rshift_expression::make_rvalue()
-{
-    Value* l = lhs->make_rvalue();
-    Value* r = rhs->make_rvalue();
-    return builder->CreateAShr(l, r);
-}
-
-Value* rshift_expression::make_lvalue()
-{
-    return nullptr;
-}
-
-Value* lshift_expression::make_rvalue()
-{
-    Value* l = lhs->make_rvalue();
-    Value* r = rhs->make_rvalue();
-    return builder->CreateShl(l, r);
-}
-
-Value* lshift_expression::make_lvalue()
-{
-    return nullptr;
-}
-
-Value* relational_expression::make_rvalue()
-{
-    return se->make_rvalue();
-}
-
-Value* relational_expression::make_lvalue()
-{
-    return se->make_lvalue();
-}
-
-Value* less_expression::make_rvalue()
-{
-    Value *l = lhs->make_rvalue();
-    Value *r = rhs->make_rvalue();
-    if (!adjust_int_ptr(l, r))
-        error::reject(op);
-    return builder->CreateICmpSLT(l, r);
-}
-
-Value* less_expression::make_lvalue()
-{
-    return nullptr;
-}
-
-Value* greater_expression::make_rvalue()
-{
-    Value *l = lhs->make_rvalue();
-    Value *r = rhs->make_rvalue();
-    if (!adjust_int_ptr(l, r))
-        error::reject(op);
-    return builder->CreateICmpSGT(l, r);
-}
-
-Value* greater_expression::make_lvalue()
-{
-    return nullptr;
-}
-
-Value* less_equal_expression::make_rvalue()
-{
-    Value *l = lhs->make_rvalue();
-    Value *r = rhs->make_rvalue();
-    if (!adjust_int_ptr(l, r))
-        error::reject(op);
-    return builder->CreateICmpSLE(l, r);
-}
-
-Value* less_equal_expression::make_lvalue()
-{
-    return nullptr;
-}
-
-Value* greater_equal_expression::make_rvalue()
-{
-    Value *l = lhs->make_rvalue();
-    Value *r = rhs->make_rvalue();
-    if (!adjust_int_ptr(l, r))
-        error::reject(op);
-    return builder->CreateICmpSGE(l, r);
-}
-
-Value* greater_equal_expression::make_lvalue()
-{
-    return nullptr;
-}
-
-Value* equality_expression::make_rvalue()
-{
-    return re->make_rvalue();
-}
-
-Value* equality_expression::make_lvalue()
-{
-    return re->make_lvalue();
-}
-
-Value* equal_expression::make_rvalue()
-{
-    Value* l = lhs->make_rvalue();
-    Value* r = rhs->make_rvalue();
-    if (!adjust_int_ptr(l, r))
-        error::reject(op);
-    return builder->CreateICmpEQ(l, r);
-}
-
-Value* equal_expression::make_lvalue()
-{
-    return nullptr;
-}
-
-Value* not_equal_expression::make_rvalue()
-{
-    Value* l = lhs->make_rvalue();
-    Value* r = rhs->make_rvalue();
-    if (!adjust_int_ptr(l, r))
-        error::reject(op);
-    return builder->CreateICmpNE(l, r);
-}
-
-Value* not_equal_expression::make_lvalue()
-{
-    return nullptr;
-}
-
-Value* and_expression::make_rvalue()
-{
-    if (ee)
-        return ee->make_rvalue();
-
-    Value* l = lhs->make_rvalue();
-    Value* r = rhs->make_rvalue();
-    if (!adjust_int(l, r))
-        error::reject(op);
-    return builder->CreateAnd(l, r);
-}
-
-Value* and_expression::make_lvalue()
-{
-    if (ee)
-        return ee->make_lvalue();
-    return nullptr;
-}
-
-Value* exclusive_or_expression::make_rvalue()
-{
-    if (ae)
-        return ae->make_rvalue();
-
-    Value* l = lhs->make_rvalue();
-    Value* r = rhs->make_rvalue();
-    if (!adjust_int(l, r))
-        error::reject(op);
-    return builder->CreateXor(l, r);
-}
-
-Value* exclusive_or_expression::make_lvalue()
-{
-    if (ae)
-        return ae->make_lvalue();
-    return nullptr;
-}
-
-Value* inclusive_or_expression::make_rvalue()
-{
-    if (xe)
-        return xe->make_rvalue();
-
-    Value* l = lhs->make_rvalue();
-    Value* r = rhs->make_rvalue();
-    if (!adjust_int(l, r))
-        error::reject(op);
-    return builder->CreateOr(l, r);
-}
-
-Value* inclusive_or_expression::make_lvalue()
-{
-    if (xe)
-        return xe->make_lvalue();
-    return nullptr;
-}
-
-Value* logical_and_expression::make_lvalue()
-{
-    if (oe)
-        return oe->make_lvalue();
-    return nullptr;
-}
-
-Value* logical_and_expression::make_rvalue()
-{
-    if (oe)
-        return oe->make_rvalue();
-
-    Function *function = builder->GetInsertBlock()->getParent();
-
-    BasicBlock *header_block = BasicBlock::Create(context, "and-header", function);
-    builder->CreateBr(header_block);
-    builder->SetInsertPoint(header_block);
-    Value *cond = truncate(lhs->make_rvalue());
-    if (!cond)
-        error::reject(op);
-
-    BasicBlock *true_block = BasicBlock::Create(context, "true", function);
-    BasicBlock *false_block = BasicBlock::Create(context, "false", function);
-    BasicBlock *ttrue_block = BasicBlock::Create(context, "ttrue", function);
-    BasicBlock *merge_block = BasicBlock::Create(context, "merge", function);
-
-    builder->CreateCondBr(cond, true_block, false_block);
-
-    builder->SetInsertPoint(true_block);
-    Value *tcond = truncate(rhs->make_rvalue());
-    if (!tcond)
-        error::reject(op);
-    builder->CreateCondBr(tcond, ttrue_block, false_block);
-
-    builder->SetInsertPoint(ttrue_block);
-    Value *tval = builder->getInt1(1);
-    builder->CreateBr(merge_block);
-    builder->SetInsertPoint(false_block);
-    Value *fval = builder->getInt1(0);
-    builder->CreateBr(merge_block);
-    builder->SetInsertPoint(merge_block);
-
-    PHINode *pn = builder->CreatePHI(Type::getInt1Ty(context), 2, "phi");
-    pn->addIncoming(tval, ttrue_block);
-    pn->addIncoming(fval, false_block);
-    return pn;
-}
-
-Value* logical_or_expression::make_lvalue()
-{
-    if (ae)
-        return ae->make_lvalue();
-    return nullptr;
-}
-
-Value* logical_or_expression::make_rvalue()
-{
-    if (ae)
-        return ae->make_rvalue();
-
-    Function *function = builder->GetInsertBlock()->getParent();
-
-    BasicBlock *header_block = BasicBlock::Create(context, "or-header", function);
-    builder->CreateBr(header_block);
-    builder->SetInsertPoint(header_block);
-    Value *cond = truncate(lhs->make_rvalue());
-    if (!cond)
-        error::reject(op);
-
-    BasicBlock *true_block = BasicBlock::Create(context, "true", function);
-    BasicBlock *false_block = BasicBlock::Create(context, "false", function);
-    BasicBlock *ffalse_block = BasicBlock::Create(context, "ffalse", function);
-    BasicBlock *merge_block = BasicBlock::Create(context, "merge", function);
-
-    builder->CreateCondBr(cond, true_block, false_block);
-
-    builder->SetInsertPoint(false_block);
-    Value *fcond = truncate(rhs->make_rvalue());
-    if (!fcond)
-        error::reject(op);
-    builder->CreateCondBr(fcond, true_block, ffalse_block);
-
-    builder->SetInsertPoint(true_block);
-    Value *tval = builder->getInt1(1);
-    builder->CreateBr(merge_block);
-    builder->SetInsertPoint(ffalse_block);
-    Value *fval = builder->getInt1(0);
-    builder->CreateBr(merge_block);
-    builder->SetInsertPoint(merge_block);
-
-    PHINode *pn = builder->CreatePHI(Type::getInt1Ty(context), 2, "phi");
-    pn->addIncoming(tval, true_block);
-    pn->addIncoming(fval, ffalse_block);
-    return pn;
-}
-
-Value* conditional_expression::make_lvalue()
-{
-    if (oe)
-        return oe->make_lvalue();
-    return nullptr;
-}
-
-Value* conditional_expression::make_rvalue()
-{
-    if (oe)
-        return oe->make_rvalue();
-
-    Function *function = builder->GetInsertBlock()->getParent();
-
-    BasicBlock *header_block = BasicBlock::Create(context, "cond-header", function);
-    BasicBlock *true_block = BasicBlock::Create(context, "true", function);
-    BasicBlock *false_block = BasicBlock::Create(context, "false", function);
-    BasicBlock *end_block = BasicBlock::Create(context, "end", function);
-
-    builder->CreateBr(header_block);
-
-    builder->SetInsertPoint(header_block);
-    Value *cond = truncate(expr1->make_rvalue());
-    if (!cond)
-        error::reject(op);
-    builder->CreateCondBr(cond, true_block, false_block);
-
-    builder->SetInsertPoint(true_block);
+    // either operand may end in a block of its own, such as the merge of &&
+    cu->builder->SetInsertPoint(true_block);
+    seal(true_block);
     Value *tval = expr2->make_rvalue();
-    builder->CreateBr(end_block);
+    BasicBlock *tend_block = cu->builder->GetInsertBlock();
+    cu->builder->CreateBr(end_block);
 
-    builder->SetInsertPoint(false_block);
+    cu->builder->SetInsertPoint(false_block);
+    seal(false_block);
     Value *fval = expr3->make_rvalue();
-    builder->CreateBr(end_block);
+    BasicBlock *fend_block = cu->builder->GetInsertBlock();
+    cu->builder->CreateBr(end_block);
 
-    if (!conditional_adjust(tval, fval, true_block, false_block))
+    if (!conditional_adjust(tval, fval, tend_block, fend_block))
         error::reject(op);
 
-    builder->SetInsertPoint(end_block);
+    cu->builder->SetInsertPoint(end_block);
+    seal(end_block);
     if (tval->getType()->isVoidTy())
         return tval;
 
-    PHINode *pn = builder->CreatePHI(tval->getType(), 2, "phi");
-    pn->addIncoming(tval, true_block);
-    pn->addIncoming(fval, false_block);
+    PHINode *pn = cu->builder->CreatePHI(tval->getType(), 2, "phi");
+    pn->addIncoming(tval, tend_block);
+    pn->addIncoming(fval, fend_block);
     return pn;
 }
 
-Value* assignment_expression::make_lvalue()
-{
-    if (op.type == INVALID)
-        return lhs->make_lvalue();
-    return nullptr;
-}
-
 Value* assignment_expression::make_rvalue()
 {
-    if (op.type == INVALID)
-        return lhs->make_rvalue();
-
-    Value* l = lhs->make_lvalue(); // conditional_expression
-    if (!l)
-        error::reject(op);
-
-    Value* r = rhs->make_rvalue(); // assignment_expression
-    if (op.str == "=")
+    target l = make_target(lhs, op);
+    Value* r = rhs->make_rvalue();
+    if (op.kind == TK_ASSIGN)
     {
-        if (!store(r, l))
+        if (!l.store(r))
             error::reject(op);
         return r;
     }
-    Value *lv = builder->CreateLoad(l);
-    if (op.str == "*=")
+    Value *lv = l.load();
+    if (op.kind == TK_MUL_ASSIGN)
     {
         Value *v = create_mul(lv, r);
         if (!v)
             error::reject(op);
-        store(v, l);
+        l.store(v);
         return v;
     }
-    if (op.str == "/=")
+    if (op.kind == TK_DIV_ASSIGN)
     {
         Value *v = create_div(lv, r);
         if (!v)
             error::reject(op);
-        store(v, l);
+        l.store(v);
         return v;
     }
-    if (op.str == "%=")
+    if (op.kind == TK_MOD_ASSIGN)
     {
         Value *v = create_rem(lv, r);
         if (!v)
             error::reject(op);
-        store(v, l);
+        l.store(v);
         return v;
     }
-    if (op.str == "+=")
+    if (op.kind == TK_ADD_ASSIGN)
     {
         Value *v = create_add(lv, r);
         if (!v)
             error::reject(op);
-        store(v, l);
+        l.store(v);
         return v;
     }
-    if (op.str == "-=")
+    if (op.kind == TK_SUB_ASSIGN)
     {
         Value *v = create_sub(lv, r);
         if (!v)
             error::reject(op);
-        store(v, l);
+        l.store(v);
         return v;
     }
-    if (op.str == "<<=")
+    if (op.kind == TK_SHL_ASSIGN)
     {
-        Value *v = builder->CreateShl(lv, r);
-        store(v, l);
+        Value *v = cu->builder->CreateShl(lv, r);
+        l.store(v);
         return v;
     }
-    if (op.str == ">>=")
+    if (op.kind == TK_SHR_ASSIGN)
     {
-        Value *v = builder->CreateAShr(lv, r);
-        store(v, l);
+        Value *v = cu->builder->CreateAShr(lv, r);
+        l.store(v);
         return v;
     }
-    if (op.str == "&=")
+    if (op.kind == TK_AND_ASSIGN)
     {
-        Value *v = builder->CreateAnd(lv, r);
-        store(v, l);
+        Value *v = cu->builder->CreateAnd(lv, r);
+        l.store(v);
         return v;
     }
-    if (op.str == "^=")
+    if (op.kind == TK_XOR_ASSIGN)
     {
-        Value *v = builder->CreateXor(lv, r);
-        store(v, l);
+        Value *v = cu->builder->CreateXor(lv, r);
+        l.store(v);
         return v;
     }
-    if (op.str == "|=")
+    if (op.kind == TK_OR_ASSIGN)
     {
-        Value *v = builder->CreateOr(lv, r);
-        store(v, l);
+        Value *v = cu->builder->CreateOr(lv, r);
+        l.store(v);
         return v;
     }
     error::reject(op);
 }
 
-Value* constant_expression::make_rvalue()
-{
-    return ce->make_rvalue();
-}
-
-Value* constant_expression::make_lvalue()
-{
-    return ce->make_lvalue();
-}
-
-Value* expression::make_rvalue()
+Value* comma_expression::make_rvalue()
 {
     Value* last = nullptr;
-    for (assignment_expression* a : ae)
-        last = a->make_rvalue();
+    for (expression* e : exprs)
+        last = e->make_rvalue();
     return last;
 }
 
-Value* expression::make_lvalue()
+Value* comma_expression::make_lvalue()
 {
-    for (int i = 0; i < ae.size() - 1; ++i)
-        ae[i]->make_rvalue();
-
-    if (!ae.empty())
-        return ae.back()->make_lvalue();
-    return nullptr;
+    evaluate_leading(this);
+    return exprs.back()->make_lvalue();
 }
 
+// The block of a label is sealed when the function ends, as a goto may
+// still jump to it.
 void goto_label::codegen()
 {
-    builder->CreateBr(block);
-    builder->SetInsertPoint(block);
+    cu->builder->CreateBr(block);
+    cu->builder->SetInsertPoint(block);
     stat->codegen();
 }
 
 void case_label::codegen()
 {
+    block->insertInto(cu->builder->GetInsertBlock()->getParent());
+    cu->builder->CreateBr(block);
+    cu->builder->SetInsertPoint(block);
+    seal(block);
+    stat->codegen();
 }
 
 void default_label::codegen()
 {
+    block->insertInto(cu->builder->GetInsertBlock()->getParent());
+    cu->builder->CreateBr(block);
+    cu->builder->SetInsertPoint(block);
+    seal(block);
+    stat->codegen();
 }
 
 void expression_statement::codegen()
@@ -1277,108 +1135,174 @@ void expression_statement::codegen()
 
 void if_statement::codegen()
 {
-    Function *function = builder->GetInsertBlock()->getParent();
+    Function *function = cu->builder->GetInsertBlock()->getParent();
 
-    BasicBlock *header_block = BasicBlock::Create(context, "if-header", function);
-    BasicBlock *then_block = BasicBlock::Create(context, "then", function);
-    BasicBlock *else_block = BasicBlock::Create(context, "else", function);
-    BasicBlock *end_block = BasicBlock::Create(context, "end", function);
+    BasicBlock *header_block = BasicBlock::Create(cu->context, "if-header", function);
+    BasicBlock *then_block = BasicBlock::Create(cu->context, "then", function);
+    BasicBlock *else_block = BasicBlock::Create(cu->context, "else", function);
+    BasicBlock *end_block = BasicBlock::Create(cu->context, "end", function);
 
-    builder->CreateBr(header_block);
-    builder->SetInsertPoint(header_block);
+    cu->builder->CreateBr(header_block);
+    cu->builder->SetInsertPoint(header_block);
+    seal(header_block);
     Value *cond = truncate(expr->make_rvalue());
     if (!cond)
         error::reject(op);
-    builder->CreateCondBr(cond, then_block, else_block);
+    cu->builder->CreateCondBr(cond, then_block, else_block);
 
-    builder->SetInsertPoint(then_block);
+    cu->builder->SetInsertPoint(then_block);
+    seal(then_block);
     stat->codegen();
-    builder->CreateBr(end_block);
+    cu->builder->CreateBr(end_block);
 
-    builder->SetInsertPoint(else_block);
+    cu->builder->SetInsertPoint(else_block);
+    seal(else_block);
     if (estat)
         estat->codegen();
-    builder->CreateBr(end_block);
+    cu->builder->CreateBr(end_block);
 
-    builder->SetInsertPoint(end_block);
+    cu->builder->SetInsertPoint(end_block);
+    seal(end_block);
 }
 
 void switch_statement::codegen()
 {
+    Function *function = cu->builder->GetInsertBlock()->getParent();
+
+    Value *cond = expr->make_rvalue();
+    if (!cond || !cond->getType()->isIntegerTy())
+        error::reject(op);
+    if (cond->getType()->getPrimitiveSizeInBits() < 32)
+        cond = extend(cond, cu->builder->getInt32Ty());
+
+    // case values, folded by the parser, are converted to the promoted
+    // condition type; the blocks are placed when codegen reaches the labels
+    SmallPtrSet<ConstantInt*, 16> values;
+    vector<ConstantInt*> constants;
+    for (case_label* cl : cases)
+    {
+        ConstantInt *c = dyn_cast<ConstantInt>(cast(cl->ce->value, cond->getType()));
+        if (!values.insert(c).second)
+            error::reject(cl->tok);
+        constants.push_back(c);
+    }
+
+    BasicBlock *end_block = BasicBlock::Create(cu->context, "switch-end");
+    BasicBlock *default_block = end_block;
+    if (dflt)
+        default_block = dflt->block = BasicBlock::Create(cu->context, "default");
+
+    SwitchInst *si = cu->builder->CreateSwitch(cond, default_block, cases.size());
+    for (size_t i = 0; i < cases.size(); ++i)
+    {
+        cases[i]->block = BasicBlock::Create(cu->context, "case");
+        si->addCase(constants[i], cases[i]->block);
+    }
+
+    BasicBlock *outer_break = cu->break_block;
+    cu->break_block = end_block;
+
+    // statements before the first label are unreachable
+    cu->builder->SetInsertPoint(BasicBlock::Create(cu->context, "switch-body", function));
+    seal(cu->builder->GetInsertBlock());
+    stat->codegen();
+    cu->builder->CreateBr(end_block);
+
+    end_block->insertInto(function);
+    cu->builder->SetInsertPoint(end_block);
+    seal(end_block);
+
+    cu->break_block = outer_break;
 }
  
 void while_statement::codegen()
 {
-    Function *function = builder->GetInsertBlock()->getParent();
+    Function *function = cu->builder->GetInsertBlock()->getParent();
 
-    BasicBlock *header_block = BasicBlock::Create(context, "while-header", function);
-    BasicBlock *body_block = BasicBlock::Create(context, "while-body", function);
-    BasicBlock *end_block = BasicBlock::Create(context, "while-end", function);
+    BasicBlock *header_block = BasicBlock::Create(cu->context, "while-header", function);
+    BasicBlock *body_block = BasicBlock::Create(cu->context, "while-body", function);
+    BasicBlock *end_block = BasicBlock::Create(cu->context, "while-end", function);
 
-    continue_block = header_block;
-    break_block = end_block;
+    BasicBlock *outer_continue = cu->continue_block;
+    BasicBlock *outer_break = cu->break_block;
+    cu->continue_block = header_block;
+    cu->break_block = end_block;
 
-    builder->CreateBr(header_block);
-    builder->SetInsertPoint(header_block);
+    cu->builder->CreateBr(header_block);
+    cu->builder->SetInsertPoint(header_block);
     Value *cond = truncate(expr->make_rvalue());
     if (!cond)
         error::reject(op);
-    builder->CreateCondBr(cond, body_block, end_block);
+    cu->builder->CreateCondBr(cond, body_block, end_block);
 
-    builder->SetInsertPoint(body_block);
+    cu->builder->SetInsertPoint(body_block);
+    seal(body_block);
     stat->codegen();
-    builder->CreateBr(header_block);
+    cu->builder->CreateBr(header_block);
+    seal(header_block);
 
-    builder->SetInsertPoint(end_block);
+    cu->builder->SetInsertPoint(end_block);
+    seal(end_block);
 
-    continue_block = break_block = nullptr;
+    cu->continue_block = outer_continue;
+    cu->break_block = outer_break;
 }
 
 void do_while_statement::codegen()
 {
-    Function *function = builder->GetInsertBlock()->getParent();
+    Function *function = cu->builder->GetInsertBlock()->getParent();
 
-    BasicBlock *header_block = BasicBlock::Create(context, "do-while-header", function);
-    BasicBlock *check_block = BasicBlock::Create(context, "do-while-check", function);
-    BasicBlock *end_block = BasicBlock::Create(context, "do-while-end", function);
+    BasicBlock *header_block = BasicBlock::Create(cu->context, "do-while-header", function);
+    BasicBlock *check_block = BasicBlock::Create(cu->context, "do-while-check", function);
+    BasicBlock *end_block = BasicBlock::Create(cu->context, "do-while-end", function);
 
-    continue_block = check_block;
-    break_block = end_block;
+    BasicBlock *outer_continue = cu->continue_block;
+    BasicBlock *outer_break = cu->break_block;
+    cu->continue_block = check_block;
+    cu->break_block = end_block;
 
-    builder->CreateBr(header_block);
-    builder->SetInsertPoint(header_block);
+    cu->builder->CreateBr(header_block);
+    cu->builder->SetInsertPoint(header_block);
     stat->codegen();
-    builder->CreateBr(check_block);
-    builder->SetInsertPoint(check_block);
+    cu->builder->CreateBr(check_block);
+    cu->builder->SetInsertPoint(check_block);
+    seal(check_block);
     Value *cond = truncate(expr->make_rvalue());
     if (!cond)
         error::reject(op);
-    builder->CreateCondBr(cond, header_block, end_block);
+    cu->builder->CreateCondBr(cond, header_block, end_block);
+    seal(header_block);
 
-    builder->SetInsertPoint(end_block);
+    cu->builder->SetInsertPoint(end_block);
+    seal(end_block);
 
-    continue_block = break_block = nullptr;
+    cu->continue_block = outer_continue;
+    cu->break_block = outer_break;
 }
 
 void for_statement::codegen()
 {
-    Function *function = builder->GetInsertBlock()->getParent();
+    Function *function = cu->builder->GetInsertBlock()->getParent();
 
-    BasicBlock *header_block = BasicBlock::Create(context, "for-header", function);
-    BasicBlock *check_block = BasicBlock::Create(context, "for-check", function);
-    BasicBlock *body_block = BasicBlock::Create(context, "for-body", function);
-    BasicBlock *end_block = BasicBlock::Create(context, "for-end", function);
+    BasicBlock *header_block = BasicBlock::Create(cu->context, "for-header", function);
+    BasicBlock *check_block = BasicBlock::Create(cu->context, "for-check", function);
+    BasicBlock *body_block = BasicBlock::Create(cu->context, "for-body", function);
+    BasicBlock *step_block = BasicBlock::Create(cu->context, "for-step", function);
+    BasicBlock *end_block = BasicBlock::Create(cu->context, "for-end", function);
 
-    continue_block = check_block;
-    break_block = end_block;
+    BasicBlock *outer_continue = cu->continue_block;
+    BasicBlock *outer_break = cu->break_block;
+    cu->continue_block = step_block;
+    cu->break_block = end_block;
 
-    builder->CreateBr(header_block);
+    cu->builder->CreateBr(header_block);
 
-    builder->SetInsertPoint(header_block);
+    cu->builder->SetInsertPoint(header_block);
+    seal(header_block);
     if (expr1) expr1->make_rvalue();
-    builder->CreateBr(check_block);
+    cu->builder->CreateBr(check_block);
 
-    builder->SetInsertPoint(check_block);
+    cu->builder->SetInsertPoint(check_block);
     Value *cond;
     if (expr2)
     {
@@ -1387,38 +1311,49 @@ void for_statement::codegen()
             error::reject(op);
     }
     else
-        cond = builder->getInt1(1);
+        cond = cu->builder->getInt1(1);
 
-    builder->CreateCondBr(cond, body_block, end_block);
+    cu->builder->CreateCondBr(cond, body_block, end_block);
 
-    builder->SetInsertPoint(body_block);
+    cu->builder->SetInsertPoint(body_block);
+    seal(body_block);
     stat->codegen();
+    cu->builder->CreateBr(step_block);
+
+    cu->builder->SetInsertPoint(step_block);
+    seal(step_block);
     if (expr3) expr3->make_rvalue();
-    builder->CreateBr(check_block);
+    cu->builder->CreateBr(check_block);
+    seal(check_block);
 
-    builder->SetInsertPoint(end_block);
+    cu->builder->SetInsertPoint(end_block);
+    seal(end_block);
 
-    continue_block = break_block = nullptr;
+    cu->continue_block = outer_continue;
+    cu->break_block = outer_break;
 }
 
 void goto_statement::codegen()
 {
-    builder->CreateBr(gl->block);
+    cu->builder->CreateBr(gl->block);
+    start_dead_block();
 }
 
 void break_statement::codegen()
 {
-    builder->CreateBr(break_block);
+    cu->builder->CreateBr(cu->break_block);
+    start_dead_block();
 }
 
 void continue_statement::codegen()
 {
-    builder->CreateBr(continue_block);
+    cu->builder->CreateBr(cu->continue_block);
+    start_dead_block();
 }
 
 void return_statement::codegen()
 {
-    Function *function = builder->GetInsertBlock()->getParent();
+    Function *function = cu->builder->GetInsertBlock()->getParent();
 
     if (expr)
     {
@@ -1429,23 +1364,17 @@ void return_statement::codegen()
         val = cast(val, function->getReturnType());
         if (!val)
             error::reject(nxt);
-        builder->CreateRet(val);
+        cu->builder->CreateRet(val);
     }
     else
     {
         if (!function->getReturnType()->isVoidTy())
             error::reject(nxt);
 
-        builder->CreateRetVoid();
+        cu->builder->CreateRetVoid();
     }
 
-    BasicBlock *dead_block = BasicBlock::Create(
-        context,
-        "DEAD_BLOCK",
-        function,
-        0);
-
-    builder->SetInsertPoint(dead_block);
+    start_dead_block();
 }
 
 void declaration_item::codegen()
@@ -1460,34 +1389,28 @@ void statement_item::codegen()
 
 void compound_statement::codegen()
 {
-    if (sc) scopes.push_back(sc);
     for (block_item* b : bi)
         b->codegen();
-    if (sc) scopes.pop_back();
 }
 
 void function_definition::codegen()
 {
-    scopes.push_back(sc);
-
-    function_object *fo = find_function(get_identifier().str);
-    if (!fo->function)
-    {
-        fo->function = Function::Create(
-            fo->type,
-            GlobalValue::ExternalLinkage,
-            get_identifier().str,
-            *module);
-    }
+    token tok = get_identifier();
+    string identifier(tok.str());
+    function_object *fo = (function_object*)dec->obj;
+    declare(fo, identifier);
 
     BasicBlock *entry_block = BasicBlock::Create(
-        context,
+        cu->context,
         "entry",
         fo->function,
         0);
 
-    builder->SetInsertPoint(entry_block);
-    alloca_builder->SetInsertPoint(entry_block);
+    ssa_builder ssa;
+    cu->ssa = &ssa;
+    cu->builder->SetInsertPoint(entry_block);
+    cu->alloca_builder->SetInsertPoint(entry_block);
+    seal(entry_block);
 
     Function::arg_iterator arg_iter = fo->function->arg_begin();
     declarator* decl = dec->unparenthesize();
@@ -1496,31 +1419,38 @@ void function_definition::codegen()
     {
         if (pard && pard->decl)
         {
-            // todo: decl should be object with storage not function declaration
-            Value *val = pard->decl->codegen();
-            store(arg_iter, val);
+            if (!pard->decl->codegen())
+                arg_iter->setName(string(pard->decl->get_identifier().str()));
+            variable_target((variable_object*)pard->decl->obj).store(&*arg_iter);
             arg_iter++;
         }
     }
 
+    // create label blocks in name order so the emitted IR is deterministic
+    vector<pair<string_view, goto_label*>> ordered;
     for (auto& [id, lab] : labels)
-        lab->block = BasicBlock::Create(context, id, fo->function);
+        ordered.emplace_back(id.str(), lab);
+    std::sort(ordered.begin(), ordered.end());
+    for (auto& [id, lab] : ordered)
+        lab->block = BasicBlock::Create(cu->context, id, fo->function);
 
     cs->codegen();
 
-    if (!builder->GetInsertBlock()->getTerminator())
+    if (!cu->builder->GetInsertBlock()->getTerminator())
     {
-        Type *ret_type = builder->getCurrentFunctionReturnType();
+        Type *ret_type = cu->builder->getCurrentFunctionReturnType();
         if (ret_type->isVoidTy())
-            builder->CreateRetVoid();
+            cu->builder->CreateRetVoid();
         else
-            builder->CreateRet(Constant::getNullValue(ret_type));
+            cu->builder->CreateRet(Constant::getNullValue(ret_type));
     }
+    ssa.finish(fo->function);
+    cu->ssa = nullptr;
 
     // todo dead return
-    verifyFunction(*fo->function);
-
-    scopes.pop_back();
+    bool broken = verifyFunction(*fo->function);
+    if (cu->opt && opt_per_function && !broken)
+        cu->opt->run(*fo->function);
 }
 
 void external_declaration::codegen()
@@ -1531,16 +1461,90 @@ void external_declaration::codegen()
         decl->codegen();
 }
 
+// Drops the internal symbols and inline definitions that nothing the unit
+// exports reaches, however they refer to each other, so that the optimizer
+// never sees them.
+static void strip_unused(Module &module)
+{
+    auto discardable = [](GlobalValue &g)
+    {
+        return g.hasLocalLinkage() || g.hasAvailableExternallyLinkage();
+    };
+
+    SmallPtrSet<Constant*, 32> live;
+    vector<Constant*> work;
+    auto reach = [&](Value *v)
+    {
+        if (Constant *c = dyn_cast<Constant>(v))
+            if (live.insert(c).second)
+                work.push_back(c);
+    };
+    for (GlobalValue &g : module.global_values())
+        if (!discardable(g))
+            reach(&g);
+
+    while (!work.empty())
+    {
+        Constant *c = work.back();
+        work.pop_back();
+        if (Function *f = dyn_cast<Function>(c))
+        {
+            for (Instruction &inst : instructions(f))
+                for (Value *op : inst.operands())
+                    reach(op);
+        }
+        else if (GlobalVariable *gv = dyn_cast<GlobalVariable>(c))
+        {
+            if (gv->hasInitializer())
+                reach(gv->getInitializer());
+        }
+        else if (!isa<GlobalValue>(c))
+            for (Value *op : c->operands())
+                reach(op);
+    }
+
+    vector<GlobalValue*> dead;
+    for (GlobalValue &g : module.global_values())
+        if (discardable(g) && !live.count(&g))
+            dead.push_back(&g);
+    for (GlobalValue *g : dead)
+    {
+        if (Function *f = dyn_cast<Function>(g))
+            f->dropAllReferences();
+        else
+            ((GlobalVariable*)g)->dropAllReferences();
+    }
+    for (GlobalValue *g : dead)
+    {
+        g->removeDeadConstantUsers();
+        g->eraseFromParent();
+    }
+}
+
 void translation_unit::codegen(const char* filename)
 {
-    module = make_unique<Module>(filename, context);
-    builder = make_unique<IRBuilder<>>(context);
-    alloca_builder = make_unique<IRBuilder<>>(context);
+    cu->module = make_unique<Module>(filename, cu->context);
+    cu->builder = make_unique<IRBuilder<>>(cu->context);
+    cu->alloca_builder = make_unique<IRBuilder<>>(cu->context);
+    if (opt_level)
+        cu->opt = make_unique<optimizer>(*cu->module, opt_level);
 
-    scopes.push_back(sc);
+    for (auto& [name, o] : imported)
+        declare(o, string(name.str()));
     for (external_declaration* d : ed)
         d->codegen();
-    scopes.pop_back();
+    strip_unused(*cu->module);
 
-    verifyModule(*module);
+    bool broken = verifyModule(*cu->module);
+    if (cu->opt && !opt_per_function && !broken)
+    {
+        if (opt_threads > 1)
+        {
+            cu->opt.reset();
+            cu->module = optimize_split(move(cu->module), opt_level, opt_threads);
+        }
+        else
+            cu->opt->run();
+    }
+    cu->opt.reset();
 }
@@ -0,0 +1,14 @@
+#include "compilation.h"
+#include "optimize.h"
+
+thread_local compilation* cu = nullptr;
+
+compilation::compilation() : previous(cu)
+{
+    cu = this;
+}
+
+compilation::~compilation()
+{
+    cu = previous;
+}
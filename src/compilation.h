@@ -0,0 +1,46 @@
+#pragma once
+#include <map>
+#include <memory>
+#include "arena.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/IR/IRBuilder.h"
+using namespace llvm;
+
+struct scope;
+struct tag;
+struct optimizer;
+class ssa_builder;
+
+// Everything compiling one translation unit touches: its own LLVMContext
+// and module, the arena holding its AST, the scope stack and struct tags of
+// the type checker, and codegen's builders. A unit is compiled start to end
+// by one thread, which reaches it through cu; units on other threads share
+// nothing with it.
+struct compilation
+{
+    compilation();
+    ~compilation();
+
+    compilation(const compilation&) = delete;
+    compilation& operator = (const compilation&) = delete;
+
+    arena nodes;
+    LLVMContext context;
+    unique_ptr<Module> module;
+
+    vector<scope*> scopes;
+    DenseMap<StructType*, tag*> struct_tags; // every tag, by its type
+    int tag_counter = 0;
+
+    unique_ptr<IRBuilder<>> builder, alloca_builder;
+    BasicBlock *continue_block = nullptr;
+    BasicBlock *break_block = nullptr;
+    ssa_builder *ssa = nullptr; // of the function being generated
+    unique_ptr<optimizer> opt;
+
+private:
+    compilation* previous;
+};
+
+// The unit being compiled by this thread.
+extern thread_local compilation* cu;
@@ -0,0 +1,245 @@
+#include "ast.h"
+#include "constant.h"
+#include "emit.h"
+#include "llvm/Support/Host.h"
+
+bool integer_constant(string_view s, uint64_t& value, unsigned& bits)
+{
+    if (s.empty())
+        return false;
+    if (s[0] == '\'')
+    {
+        const char* p = s.data() + 1;
+        const char* end = s.data() + s.size() - 1;
+        if (p >= end)
+            return false;
+        char c = *p == '\\' ? unescape_char(++p, end) : *p++;
+        value = (unsigned char)c;
+        bits = 8;
+        return p == end;
+    }
+
+    unsigned base = 10;
+    size_t i = 0;
+    if (s.size() > 2 && s[0] == '0' && (s[1] == 'x' || s[1] == 'X'))
+        base = 16, i = 2;
+    else if (s[0] == '0')
+        base = 8;
+
+    size_t first = i;
+    value = 0;
+    for (; i < s.size(); ++i)
+    {
+        char c = tolower(s[i]);
+        unsigned d = isdigit(c) ? c - '0' : c >= 'a' && c <= 'f' ? c - 'a' + 10 : 16;
+        if (d >= base)
+            break;
+        if (value > (UINT64_MAX - d) / base)
+            return false;
+        value = value * base + d;
+    }
+    if (i == first)
+        return false;
+
+    // u and l or ll in either order, ll in one case
+    bool is_unsigned = false;
+    int longs = 0;
+    auto is_u = [&] { return i < s.size() && tolower(s[i]) == 'u'; };
+    if (is_u())
+        is_unsigned = true, ++i;
+    if (i < s.size() && tolower(s[i]) == 'l')
+    {
+        longs = 1;
+        if (++i < s.size() && s[i] == s[i - 1])
+            longs = 2, ++i;
+    }
+    if (!is_unsigned && is_u())
+        is_unsigned = true, ++i;
+    if (i != s.size())
+        return false;
+
+    // a decimal constant without u is signed, others may take an unsigned
+    // type of the same width
+    bool is_signed = !is_unsigned && base == 10;
+    if (is_signed && value > INT64_MAX)
+        return false;
+    bool fits_int = value <= (is_signed ? INT32_MAX : UINT32_MAX);
+    bits = !longs && fits_int ? 32 : 64;
+    return true;
+}
+
+// Layout of the host, which sizeof folds against; nullptr if the host has
+// no target, which emitting reports.
+static const DataLayout* host_layout()
+{
+    static const unique_ptr<DataLayout> layout = []() -> unique_ptr<DataLayout>
+    {
+        ostream quiet(nullptr);
+        unique_ptr<TargetMachine> machine =
+            create_target_machine(sys::getDefaultTargetTriple(), quiet);
+        if (!machine)
+            return nullptr;
+        return make_unique<DataLayout>(machine->createDataLayout());
+    }();
+    return layout.get();
+}
+
+static ConstantInt* size_of(Type* type)
+{
+    const DataLayout* layout = host_layout();
+    if (!layout || !type->isSized())
+        return nullptr;
+    return ConstantInt::get(Type::getInt64Ty(cu->context), layout->getTypeAllocSize(type));
+}
+
+static ConstantInt* constant(const APInt& v)
+{
+    return ConstantInt::get(cu->context, v);
+}
+
+static ConstantInt* truth(bool b)
+{
+    return constant(APInt(1, b));
+}
+
+// The conversions of codegen: a narrower value is sign extended, or zero
+// extended if it is a truth value, a wider one truncated.
+static APInt convert(const APInt& v, unsigned bits)
+{
+    if (v.getBitWidth() == bits)
+        return v;
+    if (v.getBitWidth() > bits)
+        return v.trunc(bits);
+    return v.getBitWidth() == 1 ? v.zext(bits) : v.sext(bits);
+}
+
+// Brings both operands to the wider of their widths, as adjust_int does.
+static void widen(APInt& l, APInt& r)
+{
+    unsigned bits = max(l.getBitWidth(), r.getBitWidth());
+    l = convert(l, bits);
+    r = convert(r, bits);
+}
+
+ConstantInt* expression::fold()
+{
+    return nullptr;
+}
+
+ConstantInt* primary_expression::fold()
+{
+    uint64_t v;
+    unsigned bits;
+    if (tok.type != CONSTANT || !integer_constant(tok.str(), v, bits))
+        return nullptr;
+    return ConstantInt::get(IntegerType::get(cu->context, bits), v);
+}
+
+ConstantInt* unary_expression::fold()
+{
+    if (!operand->value)
+        return nullptr;
+    const APInt& v = operand->value->getValue();
+    switch (kind)
+    {
+    case UNARY_PLUS:
+        return operand->value;
+    case UNARY_MINUS:
+        return constant(-v);
+    case UNARY_COMPLEMENT:
+        return constant(~v);
+    case UNARY_NOT:
+        return truth(convert(v, 32) == 0);
+    default:
+        return nullptr;
+    }
+}
+
+ConstantInt* sizeof_expression::fold()
+{
+    Type* type = ue->static_type();
+    return type ? size_of(type) : nullptr;
+}
+
+ConstantInt* sizeof_type_expression::fold()
+{
+    return size_of(tn->type);
+}
+
+ConstantInt* cast_expression::fold()
+{
+    if (!ce->value || !tn->type->isIntegerTy())
+        return nullptr;
+    return constant(convert(ce->value->getValue(), tn->type->getIntegerBitWidth()));
+}
+
+ConstantInt* binary_expression::fold()
+{
+    if (!lhs->value || !rhs->value)
+        return nullptr;
+    APInt l = lhs->value->getValue();
+    APInt r = rhs->value->getValue();
+
+    switch (kind)
+    {
+    case BINARY_LOGICAL_AND:
+        return truth(l != 0 && r != 0);
+    case BINARY_LOGICAL_OR:
+        return truth(l != 0 || r != 0);
+    case BINARY_SHL:
+    case BINARY_SHR:
+        // codegen shifts without converting either side
+        if (l.getBitWidth() != r.getBitWidth() || r.uge(l.getBitWidth()))
+            return nullptr;
+        return constant(kind == BINARY_SHL ? l.shl(r) : l.ashr(r));
+    default:
+        break;
+    }
+
+    widen(l, r);
+    switch (kind)
+    {
+    case BINARY_MUL:
+        return constant(l * r);
+    case BINARY_DIV:
+    case BINARY_MOD:
+        // left for the program to trap on
+        if (r == 0 || (l.isMinSignedValue() && r.isAllOnesValue()))
+            return nullptr;
+        return constant(kind == BINARY_DIV ? l.sdiv(r) : l.srem(r));
+    case BINARY_ADD:
+        return constant(l + r);
+    case BINARY_SUB:
+        return constant(l - r);
+    case BINARY_LT:
+        return truth(l.slt(r));
+    case BINARY_GT:
+        return truth(l.sgt(r));
+    case BINARY_LE:
+        return truth(l.sle(r));
+    case BINARY_GE:
+        return truth(l.sge(r));
+    case BINARY_EQ:
+        return truth(l == r);
+    case BINARY_NE:
+        return truth(l != r);
+    case BINARY_AND:
+        return constant(l & r);
+    case BINARY_XOR:
+        return constant(l ^ r);
+    case BINARY_OR:
+        return constant(l | r);
+    default:
+        return nullptr;
+    }
+}
+
+ConstantInt* conditional_expression::fold()
+{
+    if (!expr1->value || !expr2->value || !expr3->value)
+        return nullptr;
+    APInt t = expr2->value->getValue();
+    APInt f = expr3->value->getValue();
+    widen(t, f);
+    return constant(expr1->value->getValue() != 0 ? t : f);
+}
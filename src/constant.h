@@ -0,0 +1,20 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <string_view>
+using namespace std;
+
+// The character an escape sequence stands for, with p just past the
+// backslash; p is left past the sequence.
+char unescape_char(const char*& p, const char* end);
+
+// Contents of a string or character literal with its escape sequences
+// replaced, without the quotes.
+string unescape(string_view s);
+
+// Value and width in bits of an integer constant as written: decimal, octal
+// or hex with an optional u, l or ll suffix, or a character constant such as
+// '\n'. Constants that fit in an int are 32 bits wide, longer ones and those
+// with an l suffix 64, and character constants 8. False if s is malformed or
+// too large for any integer type.
+bool integer_constant(string_view s, uint64_t& value, unsigned& bits);
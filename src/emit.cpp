@@ -0,0 +1,109 @@
+#include <iostream>
+#include "emit.h"
+#include "optimize.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Config/llvm-config.h"
+#include "llvm/IR/LegacyPassManager.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Host.h"
+#include "llvm/Support/Program.h"
+#include "llvm/Support/TargetSelect.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Target/TargetMachine.h"
+#include "llvm/Target/TargetOptions.h"
+#if LLVM_VERSION_MAJOR >= 14
+#include "llvm/MC/TargetRegistry.h"
+#else
+#include "llvm/Support/TargetRegistry.h"
+#endif
+using namespace llvm;
+
+unique_ptr<TargetMachine> create_target_machine(const string& triple,
+                                                ostream& err)
+{
+    static const bool initialized = []
+    {
+        InitializeNativeTarget();
+        InitializeNativeTargetAsmPrinter();
+        return true;
+    }();
+    (void)initialized;
+
+    string message;
+    const Target* target = TargetRegistry::lookupTarget(triple, message);
+    if (!target)
+    {
+        err << "c4: " << message << '\n';
+        return nullptr;
+    }
+
+    return unique_ptr<TargetMachine>(target->createTargetMachine(
+        triple, "generic", "", TargetOptions(), Reloc::PIC_, None,
+        (CodeGenOpt::Level)opt_level));
+}
+
+bool emit_file(Module& module, const string& path, output_kind kind,
+               ostream& err)
+{
+    string triple = sys::getDefaultTargetTriple();
+    unique_ptr<TargetMachine> machine = create_target_machine(triple, err);
+    if (!machine)
+        return false;
+
+    module.setTargetTriple(triple);
+    module.setDataLayout(machine->createDataLayout());
+
+    error_code ec;
+    raw_fd_ostream out(path, ec, sys::fs::OF_None);
+    if (ec)
+    {
+        err << path << ": " << ec.message() << '\n';
+        return false;
+    }
+
+    legacy::PassManager passes;
+    CodeGenFileType type = kind == OUTPUT_OBJ ? CGFT_ObjectFile
+                                              : CGFT_AssemblyFile;
+    if (machine->addPassesToEmitFile(passes, out, nullptr, type))
+    {
+        err << "c4: target cannot emit this kind of file\n";
+        return false;
+    }
+
+    passes.run(module);
+    return true;
+}
+
+string temporary_object()
+{
+    SmallString<128> object;
+    if (error_code ec = sys::fs::createTemporaryFile("c4", "o", object))
+    {
+        cerr << "c4: " << ec.message() << '\n';
+        return "";
+    }
+    return object.str().str();
+}
+
+bool link_executable(const vector<string>& objects, const string& path)
+{
+    ErrorOr<string> driver = sys::findProgramByName("cc");
+    if (!driver)
+    {
+        cerr << "c4: no cc found to link " << path << '\n';
+        return false;
+    }
+
+    vector<StringRef> args = {*driver, "-o", path};
+    for (const string& object : objects)
+        args.push_back(object);
+
+    string message;
+    if (sys::ExecuteAndWait(*driver, args, None, {}, 0, 0, &message))
+    {
+        if (!message.empty())
+            cerr << "c4: " << message << '\n';
+        return false;
+    }
+    return true;
+}
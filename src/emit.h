@@ -0,0 +1,31 @@
+#pragma once
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "llvm/IR/Module.h"
+#include "llvm/Target/TargetMachine.h"
+using namespace std;
+
+enum output_kind
+{
+    OUTPUT_ASM,
+    OUTPUT_OBJ
+};
+
+// TargetMachine for the host, configured for the current opt_level; nullptr,
+// with a message on err, if there is no such target.
+unique_ptr<llvm::TargetMachine> create_target_machine(const string& triple,
+                                                      ostream& err);
+
+// Lowers the module with the host TargetMachine and writes assembly or an
+// object file to path. Problems are reported on err; returns false then.
+bool emit_file(llvm::Module& module, const string& path, output_kind kind,
+               ostream& err);
+
+// Name of a fresh temporary object file, or empty if none could be made.
+string temporary_object();
+
+// Links object files into an executable at path with the system compiler
+// driver.
+bool link_executable(const vector<string>& objects, const string& path);
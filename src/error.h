@@ -2,19 +2,27 @@
 #include <stdexcept>
 #include "tokenize.h"
 
+// The message leaves out the position; offset says where in the source
+// buffer the offending token starts, for the caller to turn into a line and
+// column.
 struct error : std::runtime_error
 {
     error(const token& tok) :
-        std::runtime_error(to_string(tok.row)
-                           + ":"
-                           + to_string(tok.col)
-                           + ": error: "
-                           + stringify(tok.type)
-                           + ' '
-                           + tok.str)
+        std::runtime_error("error: " + describe(tok)),
+        offset(tok.offset)
     {
     }
 
+    uint32_t offset;
+
+    // Characters the lexer could not make a token of are shown as they are.
+    static string describe(const token& tok)
+    {
+        if (tok.type == INVALID && !tok.str().empty())
+            return string(tok.str());
+        return stringify(tok.type) + ' ' + string(tok.str());
+    }
+
     [[noreturn]] static void reject(token tok)
     {
         throw error(tok);
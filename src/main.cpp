@@ -1,98 +1,330 @@
 #include <iostream>
+#include <sstream>
 #include "parser.h"
+#include "pch.h"
+#include "preprocess.h"
+#include "emit.h"
+#include "optimize.h"
+#include "timing.h"
+#include <chrono>
+#include <fstream>
 #include "llvm/Support/Signals.h"
 #include "llvm/Support/PrettyStackTrace.h"
 #include "llvm/Support/FileSystem.h"
 #include "llvm/Support/raw_ostream.h"
+#include "llvm/Support/ThreadPool.h"
 using namespace std;
 
-int task_b(const char* filename)
+static bool open_source(const char* filename, const char*& begin,
+                        const char*& end, ostream& err)
 {
-    vector<token> tokens = tokenize_file(filename);
-    bool failure = false;
-    for (auto tok : tokens)
-        if (tok.type == INVALID)
-            failure = true;
-
-    for (auto tok : tokens)
-        if (tok.type != END_OF_FILE)
-            (tok.type ? cout : cerr) << filename << ':' << tok.row
-                                     << ':' << tok.col << ": " << tok.type
-                                     << ' ' << tok.str << '\n';
+    if (map_file(filename, begin, end))
+        return true;
+    err << filename << ": cannot read file\n";
+    return false;
+}
 
-    return failure ? EXIT_FAILURE : EXIT_SUCCESS;
+static void report(const error& e, token_stream& tokens, ostream& err)
+{
+    source_position pos = tokens.locate(e.offset);
+    err << pos.file << ":" << pos.row << ":" << pos.col << ": " << e.what()
+        << '\n';
 }
 
-int task_cdef(const char* filename, bool print, bool compile)
+int task_b(const char* filename, ostream& out, ostream& err)
 {
-    vector<token> tokens = tokenize_file(filename);
-    for (auto tok : tokens)
+    const char *begin, *end;
+    if (!open_source(filename, begin, end, err))
+        return EXIT_FAILURE;
+
+    token_stream tokens(filename, begin, end);
+    bool failure = false;
+    try
     {
-        if (tok.type == INVALID)
+        for (size_t i = 0; tokens.at(i).type != END_OF_FILE; ++i)
         {
-            cerr << filename << ':' << tok.row
-                 << ':' << tok.col << ": " << tok.type
-                 << ' ' << tok.str << '\n';
-            return EXIT_FAILURE;
+            const token& tok = tokens.at(i);
+            if (tok.type == INVALID)
+                failure = true;
+            source_position pos = tokens.locate(tok.offset);
+            (tok.type ? out : err) << pos.file << ':' << pos.row
+                                   << ':' << pos.col << ": " << tok.type
+                                   << ' ' << tok.str() << '\n';
         }
     }
+    catch (const error& e)
+    {
+        report(e, tokens, err);
+        return EXIT_FAILURE;
+    }
+
+    return failure ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+// What task_cdef produces once the unit has been parsed and lowered.
+enum output_mode
+{
+    MODE_TOKENIZE,
+    MODE_PARSE,
+    MODE_PRINT,
+    MODE_IR,
+    MODE_ASM,
+    MODE_OBJ,
+    MODE_EXE,
+    MODE_PCH
+};
 
+// Default output name: the input's base name without its directory and
+// extension, followed by ext.
+string output_name(const char* filename, const string& ext)
+{
+    string fn = filename;
+    size_t pos = fn.rfind('/');
+    if (pos != fn.npos)
+        fn = fn.substr(pos + 1);
+    pos = fn.rfind('.');
+    if (pos != fn.npos)
+        fn = fn.substr(0, pos);
+    return fn + ext;
+}
+
+// Given with --include-pch: read before each unit, as if the header it was
+// made from were included at the top.
+static string include_pch;
+
+int task_cdef(const char* filename, output_mode mode, string output,
+              ostream& out, ostream& err)
+{
+    const char *begin, *end;
+    if (!open_source(filename, begin, end, err))
+        return EXIT_FAILURE;
+    // preprocessed and scanned while parsing; an invalid token is reported
+    // when reached
+    token_stream tokens(filename, begin, end);
+
+    // the unit's context, module and AST live here and go away with it
+    compilation unit;
     try
     {
-        translation_unit* tu = parser(tokens).parse();
-        tu->codegen(filename);
-        if (compile)
+        translation_unit* tu = nullptr;
         {
-            string fn = filename;
-            size_t pos = fn.find('/');
-            if (pos != fn.npos)
-                fn = fn.substr(pos + 1);
-            pos = fn.find('.');
-            if (pos != fn.npos)
-                fn = fn.substr(0, pos);
-            fn += ".ll";
+            phase_timer timer(PHASE_PARSE);
+            if (!include_pch.empty()
+                && !(tu = read_pch(include_pch, tokens, err)))
+                return EXIT_FAILURE;
+            tu = parser(tokens).parse(tu);
+        }
+        {
+            phase_timer timer(PHASE_IRGEN);
+            tu->codegen(filename);
+        }
 
+        phase_timer timer(PHASE_EMIT);
+        switch (mode)
+        {
+        case MODE_TOKENIZE:
+        case MODE_PARSE:
+            break;
+        case MODE_PRINT:
+            tu->print(out);
+            break;
+        case MODE_IR:
+        {
             error_code EC;
-            raw_fd_ostream stream(fn, EC, sys::fs::OpenFlags::F_Text);
-            extern unique_ptr<Module> module;
-            module->print(stream, nullptr);
+            raw_fd_ostream stream(output.empty() ? output_name(filename, ".ll")
+                                                 : output,
+                                  EC, sys::fs::OpenFlags::F_Text);
+            unit.module->print(stream, nullptr);
+            break;
+        }
+        case MODE_ASM:
+        case MODE_OBJ:
+        case MODE_EXE:
+            if (output.empty())
+                output = output_name(filename, mode == MODE_ASM ? ".s" : ".o");
+            if (!emit_file(*unit.module, output, mode == MODE_ASM ? OUTPUT_ASM
+                                                                  : OUTPUT_OBJ,
+                           err))
+                return EXIT_FAILURE;
+            break;
+        case MODE_PCH:
+            if (!write_pch(output.empty() ? output_name(filename, ".pch")
+                                          : output, tu, tokens, err))
+                return EXIT_FAILURE;
+            break;
         }
-        if (print)
-            tu->print();
-        delete tu;
     }
     catch (const error& e)
     {
-        cerr << filename << ":" << e.what() << '\n';
+        report(e, tokens, err);
         return EXIT_FAILURE;
     }
     return EXIT_SUCCESS;
 }
 
+// One input file. When units are compiled in parallel their output is held
+// back and printed in command line order.
+struct job
+{
+    const char* filename;
+    string output;
+    ostringstream out, err;
+    int result = EXIT_FAILURE;
+
+    void run(output_mode mode, ostream& out, ostream& err)
+    {
+        if (mode == MODE_TOKENIZE)
+            result = task_b(filename, out, err);
+        else
+            result = task_cdef(filename, mode, output, out, err);
+        collect_timings();
+    }
+};
+
 int main(int argc, char **argv)
 {
-    if (argc < 2 || argc > 3)
+    sys::PrintStackTraceOnErrorSignal(argv[0]);
+    PrettyStackTraceProgram X(argc, argv);
+
+    auto start = chrono::steady_clock::now();
+    string opt, output, json_report;
+    unsigned threads = 1;
+    vector<const char*> filenames;
+    for (int i = 1; i < argc; ++i)
+    {
+        string arg = argv[i];
+        if (arg == "-o" && i + 1 < argc)
+            output = argv[++i];
+        else if (arg == "-I" && i + 1 < argc)
+            include_dirs.push_back(argv[++i]);
+        else if (arg.size() > 2 && arg.compare(0, 2, "-I") == 0)
+            include_dirs.push_back(arg.substr(2));
+        else if (arg == "-j" && i + 1 < argc)
+            threads = max(atoi(argv[++i]), 1);
+        else if (arg.size() > 2 && arg.compare(0, 2, "-j") == 0)
+            threads = max(atoi(arg.c_str() + 2), 1);
+        else if (arg.size() == 3 && arg.compare(0, 2, "-O") == 0
+                 && arg[2] >= '0' && arg[2] <= '3')
+            opt_level = arg[2] - '0';
+        else if (arg == "--include-pch" && i + 1 < argc)
+            include_pch = argv[++i];
+        else if (arg == "--opt-per-function")
+            opt_per_function = true;
+        else if (arg == "--opt-threads" && i + 1 < argc)
+            opt_threads = max(atoi(argv[++i]), 1);
+        else if (arg == "--time-report")
+            time_report = true;
+        else if (arg == "--time-report-json" && i + 1 < argc)
+        {
+            time_report = true;
+            json_report = argv[++i];
+        }
+        else if (arg.compare(0, 2, "--") == 0 && opt.empty())
+            opt = arg;
+        else
+            filenames.push_back(argv[i]);
+    }
+
+    if (filenames.empty())
     {
         cerr << "program takes file name";
         return EXIT_FAILURE;
     }
 
-    sys::PrintStackTraceOnErrorSignal(argv[0]);
-    PrettyStackTraceProgram X(argc, argv);
+    static const map<string, output_mode> modes =
+    {
+        {"--tokenize", MODE_TOKENIZE},
+        {"--parse", MODE_PARSE},
+        {"--print-ast", MODE_PRINT},
+        {"--compile", MODE_IR},
+        {"--emit-asm", MODE_ASM},
+        {"--emit-obj", MODE_OBJ},
+        {"--emit-pch", MODE_PCH}
+    };
+
+    output_mode mode = output.empty() ? MODE_IR : MODE_EXE;
+    if (!opt.empty())
+    {
+        auto it = modes.find(opt);
+        if (it == modes.end())
+            return EXIT_FAILURE;
+        mode = it->second;
+    }
+
+    if (!output.empty() && mode != MODE_EXE && filenames.size() > 1)
+    {
+        cerr << "-o cannot name the outputs of several files";
+        return EXIT_FAILURE;
+    }
+
+    // units of an executable go to temporary objects and are linked last
+    vector<job> jobs(filenames.size());
+    for (size_t i = 0; i < jobs.size(); ++i)
+    {
+        jobs[i].filename = filenames[i];
+        if (mode == MODE_EXE)
+        {
+            jobs[i].output = temporary_object();
+            if (jobs[i].output.empty())
+                return EXIT_FAILURE;
+        }
+        else
+            jobs[i].output = output;
+    }
 
-    if (argc == 3)
+    int result = EXIT_SUCCESS;
+    if (jobs.size() == 1 || threads == 1)
     {
-        string opt = argv[1];
-        if (opt == "--tokenize")
-            return task_b(argv[2]);
-        if (opt == "--parse")
-            return task_cdef(argv[2], false, false);
-        if (opt == "--print-ast")
-            return task_cdef(argv[2], true, false);
-        if (opt == "--compile")
-            return task_cdef(argv[2], false, true);
+        for (job& j : jobs)
+        {
+            j.run(mode, cout, cerr);
+            if (j.result != EXIT_SUCCESS)
+                result = j.result;
+        }
     }
     else
-        return task_cdef(argv[1], false, true);
-    return EXIT_FAILURE;
+    {
+        ThreadPool pool(hardware_concurrency(threads));
+        vector<shared_future<void>> done;
+        for (job& j : jobs)
+            done.push_back(pool.async([&j, mode] { j.run(mode, j.out, j.err); }));
+
+        for (size_t i = 0; i < jobs.size(); ++i)
+        {
+            done[i].wait();
+            cout << jobs[i].out.str();
+            cerr << jobs[i].err.str();
+            if (jobs[i].result != EXIT_SUCCESS)
+                result = jobs[i].result;
+        }
+    }
+
+    if (mode == MODE_EXE)
+    {
+        vector<string> objects;
+        for (job& j : jobs)
+            objects.push_back(j.output);
+        phase_timer timer(PHASE_EMIT);
+        if (result == EXIT_SUCCESS && !link_executable(objects, output))
+            result = EXIT_FAILURE;
+        for (const string& object : objects)
+            sys::fs::remove(object);
+    }
+
+    if (time_report)
+    {
+        collect_timings();
+        double wall = chrono::duration<double>(chrono::steady_clock::now()
+                                               - start).count();
+        if (json_report.empty())
+            print_time_report(cerr, wall);
+        else if (json_report == "-")
+            print_time_report_json(cout, wall);
+        else
+        {
+            ofstream json(json_report);
+            print_time_report_json(json, wall);
+        }
+    }
+    return result;
 }
@@ -0,0 +1,140 @@
+#include "optimize.h"
+#include "emit.h"
+#include "timing.h"
+#include "llvm/Bitcode/BitcodeReader.h"
+#include "llvm/Bitcode/BitcodeWriter.h"
+#include "llvm/Config/llvm-config.h"
+#include "llvm/Linker/Linker.h"
+#include "llvm/Support/Host.h"
+#include "llvm/Support/ThreadPool.h"
+#include "llvm/Transforms/Utils/SplitModule.h"
+using namespace llvm;
+
+int opt_level = 0;
+bool opt_per_function = false;
+unsigned opt_threads = 1;
+
+#if LLVM_VERSION_MAJOR < 14
+using OptimizationLevel = PassBuilder::OptimizationLevel;
+#endif
+
+#if LLVM_VERSION_MAJOR < 12
+static const ThinLTOPhase no_lto = ThinLTOPhase::None;
+#else
+static const ThinOrFullLTOPhase no_lto = ThinOrFullLTOPhase::None;
+#endif
+
+static OptimizationLevel pipeline_level(int level)
+{
+    switch (level)
+    {
+    case 1:
+        return OptimizationLevel::O1;
+    case 2:
+        return OptimizationLevel::O2;
+    default:
+        return OptimizationLevel::O3;
+    }
+}
+
+// Without a target the pipelines only miss its cost model; emitting is what
+// reports it missing, on the stream of the unit.
+static unique_ptr<TargetMachine> host_machine()
+{
+    ostream quiet(nullptr);
+    return create_target_machine(sys::getDefaultTargetTriple(), quiet);
+}
+
+optimizer::optimizer(Module& module, int level) :
+    module(module),
+    machine(host_machine()),
+    builder(machine.get())
+{
+    // the pipelines consult the data layout and target cost model, so the
+    // module has to know its target before anything runs
+    if (machine)
+    {
+        module.setTargetTriple(machine->getTargetTriple().str());
+        module.setDataLayout(machine->createDataLayout());
+    }
+
+    builder.registerModuleAnalyses(mam);
+    builder.registerCGSCCAnalyses(cgam);
+    builder.registerFunctionAnalyses(fam);
+    builder.registerLoopAnalyses(lam);
+    builder.crossRegisterProxies(lam, fam, cgam, mam);
+
+    function_passes = builder.buildFunctionSimplificationPipeline(
+        pipeline_level(level), no_lto);
+    module_passes = builder.buildPerModuleDefaultPipeline(pipeline_level(level));
+}
+
+void optimizer::run(Function& function)
+{
+    phase_timer timer(PHASE_OPT);
+    function_passes.run(function, fam);
+}
+
+void optimizer::run()
+{
+    phase_timer timer(PHASE_OPT);
+    module_passes.run(module, mam);
+}
+
+// Partitions travel between contexts as bitcode.
+static unique_ptr<Module> read_partition(const SmallString<0>& code,
+                                         LLVMContext& context)
+{
+    Expected<unique_ptr<Module>> part =
+        parseBitcodeFile(MemoryBufferRef(code.str(), "partition"), context);
+    if (!part)
+        report_fatal_error(part.takeError());
+    return move(*part);
+}
+
+static void write_partition(Module& part, SmallString<0>& code)
+{
+    code.clear();
+    raw_svector_ostream out(code);
+    WriteBitcodeToFile(part, out);
+}
+
+unique_ptr<Module> optimize_split(unique_ptr<Module> module, int level,
+                                  unsigned partitions)
+{
+    phase_timer timer(PHASE_OPT);
+    vector<SmallString<0>> code;
+    SplitModule(*module, partitions, [&](unique_ptr<Module> part)
+    {
+        code.emplace_back();
+        write_partition(*part, code.back());
+    }, true);
+
+    {
+        ThreadPool pool(hardware_concurrency(partitions));
+        for (SmallString<0>& c : code)
+        {
+            pool.async([&c, level]
+            {
+                LLVMContext context;
+                unique_ptr<Module> part = read_partition(c, context);
+                {
+                    phase_timer timer(PHASE_OPT);
+                    optimizer(*part, level).run();
+                    write_partition(*part, c);
+                }
+                collect_timings();
+            });
+        }
+        pool.wait();
+    }
+
+    LLVMContext& context = module->getContext();
+    auto linked = make_unique<Module>(module->getModuleIdentifier(), context);
+    linked->setSourceFileName(module->getSourceFileName());
+    module.reset();
+    for (SmallString<0>& c : code)
+        if (Linker::linkModules(*linked, read_partition(c, context)))
+            report_fatal_error("cannot link optimized partitions");
+    return linked;
+}
@@ -0,0 +1,44 @@
+#pragma once
+#include <memory>
+#include "llvm/Passes/PassBuilder.h"
+#include "llvm/Target/TargetMachine.h"
+using namespace std;
+
+// Level given with -O0 .. -O3, whether functions are optimized one by one
+// as soon as codegen finishes them instead of as a whole module, and on how
+// many threads the module of one unit is optimized.
+extern int opt_level;
+extern bool opt_per_function;
+extern unsigned opt_threads;
+
+// The new pass manager pipelines of one optimization level, set up for one
+// module. Level 0 must not be used: there is nothing to run then.
+struct optimizer
+{
+    optimizer(llvm::Module& module, int level);
+
+    // function simplification pipeline: mem2reg/SROA, combining, CFG cleanup
+    void run(llvm::Function& function);
+
+    // the whole per-module default pipeline, including inlining
+    void run();
+
+private:
+    llvm::Module& module;
+    unique_ptr<llvm::TargetMachine> machine;
+    llvm::PassBuilder builder;
+    llvm::LoopAnalysisManager lam;
+    llvm::FunctionAnalysisManager fam;
+    llvm::CGSCCAnalysisManager cgam;
+    llvm::ModuleAnalysisManager mam;
+    llvm::FunctionPassManager function_passes;
+    llvm::ModulePassManager module_passes;
+};
+
+// Splits the module into partitions that are optimized concurrently, each in
+// a context of its own, and links the results back in partition order, so
+// the outcome does not depend on thread timing. Calls across partitions are
+// not inlined; internal symbols go with their users, so that they stay
+// internal.
+unique_ptr<llvm::Module> optimize_split(unique_ptr<llvm::Module> module,
+                                        int level, unsigned partitions);
@@ -1,105 +1,159 @@
 #include "parser.h"
+#include "timing.h"
 
-primary_expression* parser::parse_primary_expression()
+static bool is_builtin_type(token_kind kind)
+{
+    switch (kind)
+    {
+    case KW_VOID: case KW_CHAR: case KW_SHORT: case KW_INT: case KW_LONG:
+    case KW_FLOAT: case KW_DOUBLE: case KW_SIGNED: case KW_UNSIGNED:
+    case KW_BOOL: case KW_COMPLEX:
+        return true;
+    default:
+        return false;
+    }
+}
+
+static bool is_type_qualifier(token_kind kind)
+{
+    return kind == KW_CONST || kind == KW_RESTRICT || kind == KW_VOLATILE
+        || kind == KW_ATOMIC;
+}
+
+static bool is_function_specifier(token_kind kind)
+{
+    return kind == KW_INLINE || kind == KW_NORETURN;
+}
+
+static bool is_storage_class_specifier(token_kind kind)
+{
+    switch (kind)
+    {
+    case KW_TYPEDEF: case KW_EXTERN: case KW_STATIC: case KW_THREAD_LOCAL:
+    case KW_AUTO: case KW_REGISTER:
+        return true;
+    default:
+        return false;
+    }
+}
+
+static bool is_assignment_operator(token_kind kind)
+{
+    switch (kind)
+    {
+    case TK_ASSIGN: case TK_MUL_ASSIGN: case TK_DIV_ASSIGN: case TK_MOD_ASSIGN:
+    case TK_ADD_ASSIGN: case TK_SUB_ASSIGN: case TK_SHL_ASSIGN:
+    case TK_SHR_ASSIGN: case TK_AND_ASSIGN: case TK_XOR_ASSIGN: case TK_OR_ASSIGN:
+        return true;
+    default:
+        return false;
+    }
+}
+
+bool parser::starts_type_name(const token& tok)
+{
+    return is_builtin_type(tok.kind) || is_type_qualifier(tok.kind)
+        || tok.kind == KW_STRUCT || tok.kind == KW_UNION;
+}
+
+bool parser::starts_declaration_specifiers(const token& tok)
+{
+    return starts_type_name(tok) || is_function_specifier(tok.kind)
+        || is_storage_class_specifier(tok.kind);
+}
+
+expression* parser::parse_primary_expression()
 {
     if (tokit->type == IDENTIFIER)
     {
-        primary_expression* pe = new primary_expression;
-        pe->var = accept(find_var((pe->tok = *tokit).str));
+        primary_expression* pe = make<primary_expression>();
+        pe->var = accept(find_var((pe->tok = *tokit).sym));
         tokit++;
         return pe;
     }
     if (tokit->type == CONSTANT)
     {
-        primary_expression* pe = new primary_expression;
+        primary_expression* pe = make<primary_expression>();
         pe->tok = parse_token();
+        if (!(pe->value = pe->fold()))
+            error::reject(pe->tok); // malformed or too large
         return pe;
     }
     if (tokit->type == STRING_LITERAL)
     {
-        primary_expression* pe = new primary_expression;
+        primary_expression* pe = make<primary_expression>();
         pe->tok = parse_token();
         return pe;
     }
-    token_iter old = tokit;
-    if (check("("))
+    // a type name after the parenthesis makes it a cast instead
+    if (tokit->kind == TK_LPAREN && !starts_type_name(tokit[1]))
     {
-        parenthesized_expression* pe = new parenthesized_expression;
-        pe->expr = parse_expression();
-        // maybe it's a type cast
-        if (!pe->expr)
-        {
-            tokit = old;
-            delete pe;
-            return nullptr;
-        }
-        accepts(")");
-        return pe;
+        ++tokit;
+        expression* expr = accept(parse_expression());
+        accepts(TK_RPAREN);
+        return expr;
     }
     return nullptr;
 }
 
-postfix_expression* parser::parse_postfix_expression()
+expression* parser::parse_postfix_expression()
 {
-    primary_expression* pe = parse_primary_expression();
-    if (!pe)
+    expression* e = parse_primary_expression();
+    if (!e)
         return nullptr;
 
-    postfix_expression* e = new postfix_expression;
-    e->pe = pe;
-
     while (true)
     {
-        if (check("["))
+        if (check(TK_LBRACKET))
         {
-            subscript_expression* se = new subscript_expression;
+            subscript_expression* se = make<subscript_expression>();
             se->op = prev_token();
             se->pfe = e;
             se->expr = accept(parse_expression());
-            accepts("]");
+            accepts(TK_RBRACKET);
             e = se;
         }
-        else if (check("("))
+        else if (check(TK_LPAREN))
         {
-            call_expression* ce = new call_expression;
+            call_expression* ce = make<call_expression>();
             ce->opop = prev_token();
             ce->pfe = e;
-            if (assignment_expression* ae = parse_assignment_expression())
+            if (expression* ae = parse_assignment_expression())
             {
                 ce->args.push_back(ae);
-                while (check(","))
+                while (check(TK_COMMA))
                     ce->args.push_back(accept(parse_assignment_expression()));
             }
             ce->op = *tokit;
-            accepts(")");
+            accepts(TK_RPAREN);
             e = ce;
         }
-        else if (check("."))
+        else if (check(TK_DOT))
         {
-            dot_expression* de = new dot_expression;
+            dot_expression* de = make<dot_expression>();
             de->op = prev_token();
             de->pfe = e;
             de->id = parse_identifier();
             e = de;
         }
-        else if (check("->"))
+        else if (check(TK_ARROW))
         {
-            arrow_expression* ae = new arrow_expression;
+            arrow_expression* ae = make<arrow_expression>();
             ae->op = prev_token();
             ae->pfe = e;
             ae->id = parse_identifier();
             e = ae;
         }
-        else if (check("++"))
+        else if (check(TK_INC))
         {
-            postfix_increment_expression* ie = new postfix_increment_expression;
+            postfix_increment_expression* ie = make<postfix_increment_expression>();
             ie->op = prev_token();
             ie->pfe = e;
             e = ie;
         }
-        else if (check("--"))
+        else if (check(TK_DEC))
         {
-            postfix_decrement_expression* de = new postfix_decrement_expression;
+            postfix_decrement_expression* de = make<postfix_decrement_expression>();
             de->op = prev_token();
             de->pfe = e;
             e = de;
@@ -110,90 +164,65 @@ postfix_expression* parser::parse_postfix_expression()
     return e;
 }
 
-unary_expression* parser::parse_unary_expression()
+// A local whose address is taken has to live in memory.
+static void take_address(expression* e)
 {
-    if (postfix_expression* pe = parse_postfix_expression())
-    {
-        unary_expression* ue = new unary_expression;
-        ue->pe = pe;
-        return ue;
-    }
-    if (check("++"))
-    {
-        prefix_increment_expression* ie = new prefix_increment_expression;
-        ie->op = prev_token();
-        ie->ue = accept(parse_unary_expression());
-        return ie;
-    }
-    if (check("--"))
-    {
-        prefix_decrement_expression* de = new prefix_decrement_expression;
-        de->op = prev_token();
-        de->ue = accept(parse_unary_expression());
-        return de;
-    }
-    if (check("&"))
-    {
-        unary_and_expression* ae = new unary_and_expression;
-        ae->op = prev_token();
-        ae->ce = accept(parse_cast_expression());
-        return ae;
-    }
-    if (check("*"))
-    {
-        unary_star_expression* se = new unary_star_expression;
-        se->op = prev_token();
-        se->ce = accept(parse_cast_expression());
-        return se;
-    }
-    if (check("+"))
-    {
-        unary_plus_expression* pe = new unary_plus_expression;
-        pe->op = prev_token();
-        pe->ce = accept(parse_cast_expression());
+    if (comma_expression* ce = dynamic_cast<comma_expression*>(e))
+        return take_address(ce->exprs.back());
+    primary_expression* pe = dynamic_cast<primary_expression*>(e);
+    if (pe && pe->var && pe->var->kind == OBJECT_VARIABLE)
+        ((variable_object*)pe->var)->address_taken = true;
+}
+
+expression* parser::parse_unary_expression()
+{
+    if (expression* pe = parse_postfix_expression())
         return pe;
-    }
-    if (check("-"))
-    {
-        unary_minus_expression* me = new unary_minus_expression;
-        me->op = prev_token();
-        me->ce = accept(parse_cast_expression());
-        return me;
-    }
-    if (check("~"))
+
+    static const pair<token_kind, unary_op> prefix_operators[] =
     {
-        unary_tilde_expression* te = new unary_tilde_expression;
-        te->op = prev_token();
-        te->ce = accept(parse_cast_expression());
-        return te;
-    }
-    if (check("!"))
+        {TK_INC, UNARY_INCREMENT}, {TK_DEC, UNARY_DECREMENT},
+        {TK_AMP, UNARY_ADDRESS}, {TK_STAR, UNARY_DEREFERENCE},
+        {TK_PLUS, UNARY_PLUS}, {TK_MINUS, UNARY_MINUS},
+        {TK_TILDE, UNARY_COMPLEMENT}, {TK_NOT, UNARY_NOT}
+    };
+    for (auto& [tk, kind] : prefix_operators)
     {
-        unary_not_expression* ne = new unary_not_expression;
-        ne->op = prev_token();
-        ne->ce = accept(parse_cast_expression());
-        return ne;
+        if (check(tk))
+        {
+            unary_expression* ue = make<unary_expression>();
+            ue->kind = kind;
+            ue->op = prev_token();
+            // ++ and -- take a unary expression, the others a cast expression
+            if (kind == UNARY_INCREMENT || kind == UNARY_DECREMENT)
+                ue->operand = accept(parse_unary_expression());
+            else
+                ue->operand = accept(parse_cast_expression());
+            if (kind == UNARY_ADDRESS)
+                take_address(ue->operand);
+            ue->value = ue->fold();
+            return ue;
+        }
     }
-    if (check("sizeof"))
+    if (check(KW_SIZEOF))
     {
         token tok = prev_token();
-        if (check("("))
+        if (tokit->kind == TK_LPAREN && starts_type_name(tokit[1]))
         {
-            if (type_name* tn = parse_type_name())
-            {
-                sizeof_type_expression* se = new sizeof_type_expression;
-                se->op = tok;
-                se->tn = tn;
-                accepts(")");
-                return se;
-            }
-            tokit--;
+            ++tokit;
+            sizeof_type_expression* se = make<sizeof_type_expression>();
+            se->op = tok;
+            se->tn = accept(parse_type_name());
+            accepts(TK_RPAREN);
+            se->value = se->fold();
+            return se;
         }
-        if (unary_expression* ue = parse_unary_expression())
+        if (expression* ue = parse_unary_expression())
         {
-            sizeof_expression* se = new sizeof_expression;
+            sizeof_expression* se = make<sizeof_expression>();
             se->op = tok;
             se->ue = ue;
+            se->value = se->fold();
             return se;
         }
         reject();
@@ -201,441 +230,297 @@ unary_expression* parser::parse_unary_expression()
     return nullptr;
 }
 
-cast_expression* parser::parse_cast_expression()
+expression* parser::parse_cast_expression()
 {
-    if (unary_expression* ue = parse_unary_expression())
-    {
-        cast_expression* ce = new cast_expression;
-        ce->ue = ue;
-        return ce;
-    }
-    if (check("("))
+    if (expression* ue = parse_unary_expression())
+        return ue;
+    if (check(TK_LPAREN))
     {
-        cast_expression* ce = new cast_expression;
+        cast_expression* ce = make<cast_expression>();
         ce->op = prev_token();
         ce->tn = accept(parse_type_name());
-        accepts(")");
+        accepts(TK_RPAREN);
         ce->ce = accept(parse_cast_expression());
+        ce->value = ce->fold();
         return ce;
     }
     return nullptr;
 }
 
-multiplicative_expression* parser::parse_multiplicative_expression()
+// Precedence of a binary operator token, 0 for any other token. Higher
+// binds tighter; all binary operators are left associative.
+static int binary_precedence(token_kind kind, binary_op& op)
 {
-    cast_expression* ce = parse_cast_expression();
-    if (!ce)
-        return nullptr;
-
-    multiplicative_expression* lhs = new multiplicative_expression;
-    lhs->ce = ce;
-
-    while (true)
-    {
-        if (check("*"))
-        {
-            mul_expression* me = new mul_expression;
-            me->op = prev_token();
-            me->lhs = lhs;
-            me->rhs = accept(parse_cast_expression());
-            lhs = me;
-        }
-        else if (check("/"))
-        {
-            div_expression* de = new div_expression;
-            de->op = prev_token();
-            de->lhs = lhs;
-            de->rhs = accept(parse_cast_expression());
-            lhs = de;
-        }
-        else if (check("%"))
-        {
-            mod_expression* me = new mod_expression;
-            me->op = prev_token();
-            me->lhs = lhs;
-            me->rhs = accept(parse_cast_expression());
-            lhs = me;
-        }
-        else
-            break;
+    switch (kind)
+    {
+    case TK_STAR: op = BINARY_MUL; return 10;
+    case TK_SLASH: op = BINARY_DIV; return 10;
+    case TK_PERCENT: op = BINARY_MOD; return 10;
+    case TK_PLUS: op = BINARY_ADD; return 9;
+    case TK_MINUS: op = BINARY_SUB; return 9;
+    case TK_SHL: op = BINARY_SHL; return 8;
+    case TK_SHR: op = BINARY_SHR; return 8;
+    case TK_LT: op = BINARY_LT; return 7;
+    case TK_GT: op = BINARY_GT; return 7;
+    case TK_LE: op = BINARY_LE; return 7;
+    case TK_GE: op = BINARY_GE; return 7;
+    case TK_EQ: op = BINARY_EQ; return 6;
+    case TK_NE: op = BINARY_NE; return 6;
+    case TK_AMP: op = BINARY_AND; return 5;
+    case TK_CARET: op = BINARY_XOR; return 4;
+    case TK_PIPE: op = BINARY_OR; return 3;
+    case TK_AND_AND: op = BINARY_LOGICAL_AND; return 2;
+    case TK_OR_OR: op = BINARY_LOGICAL_OR; return 1;
+    default: return 0;
     }
-    return lhs;
 }
 
-additive_expression* parser::parse_additive_expression()
+expression* parser::parse_binary_expression(int min_precedence)
 {
-    multiplicative_expression* me = parse_multiplicative_expression();
-    if (!me)
+    expression* lhs = parse_cast_expression();
+    if (!lhs)
         return nullptr;
 
-    additive_expression* lhs = new additive_expression;
-    lhs->me = me;
-
-    while (true)
+    binary_op kind;
+    while (int precedence = binary_precedence(tokit->kind, kind))
     {
-        if (check("+"))
-        {
-            add_expression* ae = new add_expression;
-            ae->op = prev_token();
-            ae->lhs = lhs;
-            ae->rhs = accept(parse_multiplicative_expression());
-            lhs = ae;
-        }
-        else if (check("-"))
-        {
-            sub_expression* se = new sub_expression;
-            se->op = prev_token();
-            se->lhs = lhs;
-            se->rhs = accept(parse_multiplicative_expression());
-            lhs = se;
-        }
-        else
+        if (precedence < min_precedence)
             break;
+        binary_expression* be = make<binary_expression>();
+        be->kind = kind;
+        be->op = parse_token();
+        be->lhs = lhs;
+        be->rhs = accept(parse_binary_expression(precedence + 1));
+        be->value = be->fold();
+        lhs = be;
     }
     return lhs;
 }
 
-shift_expression* parser::parse_shift_expression()
+expression* parser::parse_conditional_expression()
 {
-    additive_expression* ae = parse_additive_expression();
-    if (!ae)
-        return nullptr;
-
-    shift_expression* lhs = new shift_expression;
-    lhs->ae = ae;
-
-    while (true)
-    {
-        if (check("<<"))
-        {
-            lshift_expression* ae = new lshift_expression;
-            ae->op = prev_token();
-            ae->lhs = lhs;
-            ae->rhs = accept(parse_additive_expression());
-            lhs = ae;
-        }
-        else if (check(">>"))
-        {
-            rshift_expression* ae = new rshift_expression;
-            ae->op = prev_token();
-            ae->lhs = lhs;
-            ae->rhs = accept(parse_additive_expression());
-            lhs = ae;
-        }
-        else
-            break;
-    }
-    return lhs;
+    expression* oe = parse_binary_expression(1);
+    if (!oe || !check(TK_QUESTION))
+        return oe;
+
+    conditional_expression* ce = make<conditional_expression>();
+    ce->op = prev_token();
+    ce->expr1 = oe;
+    ce->expr2 = accept(parse_expression());
+    accepts(TK_COLON);
+    ce->expr3 = accept(parse_conditional_expression());
+    ce->value = ce->fold();
+    return ce;
 }
 
-relational_expression* parser::parse_relational_expression()
+expression* parser::parse_assignment_expression()
 {
-    shift_expression* se = parse_shift_expression();
-    if (!se)
-        return nullptr;
-
-    relational_expression* lhs = new relational_expression;
-    lhs->se = se;
-
-    while (true)
-    {
-        if (check("<"))
-        {
-            less_expression* le = new less_expression;
-            le->op = prev_token();
-            le->lhs = lhs;
-            le->rhs = accept(parse_shift_expression());
-            lhs = le;
-        }
-        else if (check(">"))
-        {
-            greater_expression* ge = new greater_expression;
-            ge->op = prev_token();
-            ge->lhs = lhs;
-            ge->rhs = accept(parse_shift_expression());
-            lhs = ge;
-        }
-        else if (check("<="))
-        {
-            less_equal_expression* le = new less_equal_expression;
-            le->op = prev_token();
-            le->lhs = lhs;
-            le->rhs = accept(parse_shift_expression());
-            lhs = le;
-        }
-        else if (check(">="))
-        {
-            greater_equal_expression* ge = new greater_equal_expression;
-            ge->op = prev_token();
-            ge->lhs = lhs;
-            ge->rhs = accept(parse_shift_expression());
-            lhs = ge;
-        }
-        else
-            break;
-    }
-    return lhs;
+    expression* lhs = parse_conditional_expression();
+    if (!lhs || !is_assignment_operator(tokit->kind))
+        return lhs;
+
+    assignment_expression* ae = make<assignment_expression>();
+    ae->lhs = lhs;
+    ae->op = parse_token();
+    ae->rhs = accept(parse_assignment_expression());
+    return ae;
 }
 
-equality_expression* parser::parse_equality_expression()
+expression* parser::parse_constant_expression()
 {
-    relational_expression* re = parse_relational_expression();
-    if (!re)
-        return nullptr;
-
-    equality_expression* lhs = new equality_expression;
-    lhs->re = re;
-
-    while (true)
-    {
-        if (check("=="))
-        {
-            equal_expression* ee = new equal_expression;
-            ee->op = prev_token();
-            ee->lhs = lhs;
-            ee->rhs = accept(parse_relational_expression());
-            lhs = ee;
-        }
-        if (check("!="))
-        {
-            not_equal_expression* ne = new not_equal_expression;
-            ne->op = prev_token();
-            ne->lhs = lhs;
-            ne->rhs = accept(parse_relational_expression());
-            lhs = ne;
-        }
-        else
-            break;
-    }
-    return lhs;
+    return parse_conditional_expression();
 }
 
-and_expression* parser::parse_and_expression()
+expression* parser::parse_expression()
 {
-    equality_expression* ee = parse_equality_expression();
-    if (!ee)
-        return nullptr;
-
-    and_expression* lhs = new and_expression;
-    lhs->ee = ee;
+    expression* ae = parse_assignment_expression();
+    if (!ae || tokit->kind != TK_COMMA)
+        return ae;
 
-    while (check("&"))
-    {
-        and_expression* ae = new and_expression;
-        ae->op = prev_token();
-        ae->lhs = lhs;
-        ae->rhs = accept(parse_equality_expression());
-        lhs = ae;
-    }
-    return lhs;
+    comma_expression* expr = make<comma_expression>();
+    expr->exprs.push_back(ae);
+    while (check(TK_COMMA))
+        expr->exprs.push_back(accept(parse_assignment_expression()));
+    return expr;
 }
 
-exclusive_or_expression* parser::parse_exclusive_or_expression()
+declaration* parser::parse_declaration()
 {
-    and_expression* ae = parse_and_expression();
-    if (!ae)
+    declaration_specifiers* ds = parse_declaration_specifiers();
+    if (!ds)
         return nullptr;
-
-    exclusive_or_expression* lhs = new exclusive_or_expression;
-    lhs->ae = ae;
-
-    while (check("^"))
-    {
-        exclusive_or_expression* xe = new exclusive_or_expression;
-        xe->op = prev_token();
-        xe->lhs = lhs;
-        xe->rhs = accept(parse_and_expression());
-        lhs = xe;
-    }
-    return lhs;
+    if (ds->sus) ds->type = register_type(ds->sus);
+    return parse_declaration(ds, parse_declarator());
 }
 
-inclusive_or_expression* parser::parse_inclusive_or_expression()
+declaration* parser::parse_declaration(declaration_specifiers* ds, declarator* first)
 {
-    exclusive_or_expression* xe = parse_exclusive_or_expression();
-    if (!xe)
-        return nullptr;
-
-    inclusive_or_expression* lhs = new inclusive_or_expression;
-    lhs->xe = xe;
-
-    while (check("|"))
+    declaration* decl = make<declaration>();
+    decl->ds = ds;
+    if (first)
     {
-        inclusive_or_expression* oe = new inclusive_or_expression;
-        oe->op = prev_token();
-        oe->lhs = lhs;
-        oe->rhs = accept(parse_exclusive_or_expression());
-        lhs = oe;
+        decl->d.push_back(parse_init_declarator(ds, first));
+        while (check(TK_COMMA))
+            decl->d.push_back(parse_init_declarator(ds, accept(parse_declarator())));
     }
-    return lhs;
-}
-
-logical_and_expression* parser::parse_logical_and_expression()
-{
-    inclusive_or_expression* oe = parse_inclusive_or_expression();
-    if (!oe)
-        return nullptr;
-
-    logical_and_expression* lhs = new logical_and_expression;
-    lhs->oe = oe;
+    accepts(TK_SEMICOLON);
 
-    while (check("&&"))
-    {
-        logical_and_expression* ae = new logical_and_expression;
-        ae->op = prev_token();
-        ae->lhs = lhs;
-        ae->rhs = accept(parse_inclusive_or_expression());
-        lhs = ae;
-    }
-    return lhs;
+    // you can do struct x; but not int;
+    if (!ds->sus && decl->d.empty())
+        reject(1);
+    return decl;
 }
 
-logical_or_expression* parser::parse_logical_or_expression()
+// Carries the storage class of a declaration of a function over to its
+// object. static gives internal linkage, which a later declaration keeps
+// and cannot give to one declared without it.
+static void link_function(function_object* fo, declaration_specifiers* ds,
+                          bool first, bool file_scope, const token& identifier)
 {
-    logical_and_expression* ae = parse_logical_and_expression();
-    if (!ae)
-        return nullptr;
-
-    logical_or_expression* lhs = new logical_or_expression;
-    lhs->ae = ae;
-
-    while (check("||"))
+    if (ds->is_static)
     {
-        logical_or_expression* oe = new logical_or_expression;
-        oe->op = prev_token();
-        oe->lhs = lhs;
-        oe->rhs = accept(parse_logical_and_expression());
-        lhs = oe;
+        if (!file_scope || (!first && !fo->internal))
+            error::reject(identifier);
+        fo->internal = true;
     }
-    return lhs;
+    if (file_scope)
+        fo->inline_only &= ds->is_inline && !ds->is_extern;
 }
 
-conditional_expression* parser::parse_conditional_expression()
+// Binds d to what it declares, checking it against earlier declarations of
+// the name.
+void parser::bind_declarator(declaration_specifiers* ds, declarator* d)
 {
-    if (logical_or_expression* oe = parse_logical_or_expression())
-    {
-        conditional_expression* ce = new conditional_expression;
-        if (check("?"))
+    phase_timer timer(PHASE_SEMA);
+    scope* s = cu->scopes.back();
+    auto& table = s->vars;
+    auto& globals = cu->scopes.front()->vars;
+    token identifier = d->get_identifier();
+    if (d->dd->is_identifier() || d->dd->is_definition())
+    {
+        // TOOD: check which tag (union or struct)
+        if (ds->sus)
         {
-            ce->op = prev_token();
-            ce->expr1 = oe;
-            ce->expr2 = accept(parse_expression());
-            accepts(":");
-            ce->expr3 = accept(parse_conditional_expression());
+            if (!d->is_pointer() && !find_tag(ds->sus->id.sym)->is_complete)
+                error::reject(identifier); // incomplete type
         }
-        else
-            ce->oe = oe;
-
-        return ce;
-    }
-    return nullptr;
-}
+        if (ds->is_inline)
+            error::reject(identifier);
 
-assignment_expression* parser::parse_assignment_expression()
-{
-    if (conditional_expression* ce = parse_conditional_expression())
-    {
-        assignment_expression* ae = new assignment_expression;
-        ae->lhs = ce;
-        if (check_any({"=", "*=", "/=", "%=", "+=", "-=", "<<=", ">>=", "&=", "^=", "|="}))
+        // declared with extern in a block, it is still the variable of the
+        // file
+        object* prev = nullptr;
+        auto table_elem = table.find(identifier.sym);
+        if (table_elem != table.end())
+            prev = table_elem->second;
+        else if (ds->is_extern && globals.count(identifier.sym))
+            prev = globals.at(identifier.sym);
+
+        Type *type = d->gen_type(ds->type);
+        variable_object* vo;
+        if (prev)
         {
-            ae->op = parse_token();
-            ae->rhs = accept(parse_assignment_expression());
+            // only declarations with linkage may repeat, and must agree
+            auto global_elem = globals.find(identifier.sym);
+            bool linked = global_elem != globals.end() && global_elem->second == prev;
+            if (!linked || (!s->global && !ds->is_extern)
+                || prev->kind != OBJECT_VARIABLE)
+                error::reject(identifier); // redefinition
+            vo = (variable_object*)prev;
+            if (vo->type != type || (ds->is_static && !vo->internal)
+                || (!ds->is_static && !ds->is_extern && vo->internal))
+                error::reject(identifier);
+            if (table_elem == table.end())
+                table.emplace(identifier.sym, vo);
         }
-        return ae;
+        else
+        {
+            vo = make<variable_object>(type, s->global || ds->is_static || ds->is_extern);
+            vo->internal = ds->is_static;
+            table.emplace(identifier.sym, vo);
+            if (ds->is_extern && !s->global)
+                globals.emplace(identifier.sym, vo);
+        }
+        if (s->global ? !ds->is_extern : ds->is_static)
+            vo->is_defined = true;
+        d->obj = vo;
     }
-    return nullptr;
-}
-
-constant_expression* parser::parse_constant_expression()
-{
-    if (conditional_expression* ce = parse_conditional_expression())
+    else
     {
-        constant_expression* c = new constant_expression;
-        c->ce = ce;
-        return c;
+        auto table_elem = table.find(identifier.sym);
+        bool first = false;
+        if (table_elem != table.end())
+        {
+            if (table_elem->second->kind != OBJECT_FUNCTION)
+                error::reject(identifier); // redeclaration as different kind
+            d->obj = table_elem->second;
+        }
+        else
+        {
+            // declared in a block, it is still the function of the file
+            auto global_elem = globals.find(identifier.sym);
+            if (global_elem != globals.end()
+                && global_elem->second->kind == OBJECT_FUNCTION)
+                d->obj = global_elem->second;
+            else
+            {
+                function_object *fo = make<function_object>(false);
+                fo->type = (FunctionType*)d->gen_type(ds->type);
+                d->obj = fo;
+                first = true;
+                if (global_elem == globals.end())
+                    globals.emplace(identifier.sym, fo);
+            }
+            table.emplace(identifier.sym, d->obj);
+        }
+        link_function((function_object*)d->obj, ds, first, s->global, identifier);
     }
-    return nullptr;
 }
 
-expression* parser::parse_expression()
+// Reads the initializer of d after binding it, so that d is in its scope.
+declarator* parser::parse_init_declarator(declaration_specifiers* ds, declarator* d)
 {
-    if (assignment_expression* ae = parse_assignment_expression())
-    {
-        expression* expr = new expression;
-        expr->ae.push_back(ae);
-        while (check(","))
-            expr->ae.push_back(accept(parse_assignment_expression()));
-        return expr;
-    }
-    return nullptr;
+    bind_declarator(ds, d);
+    if (check(TK_ASSIGN))
+    {
+        // once, for a variable defined here
+        variable_object* vo = (variable_object*)d->obj;
+        if (d->obj->kind != OBJECT_VARIABLE || vo->has_initializer
+            || (ds->is_extern && !cu->scopes.back()->global))
+            error::reject(d->get_identifier());
+        vo->has_initializer = vo->is_defined = true;
+        d->init = accept(parse_initializer());
+    }
+    return d;
 }
 
-declaration* parser::parse_declaration()
+// A braced list may end in a comma.
+initializer* parser::parse_initializer()
 {
-    token_iter old = tokit;
-    if (declaration_specifiers* ds = parse_declaration_specifiers())
+    token tok = *tokit;
+    if (check(TK_LBRACE))
     {
-        declaration* decl = new declaration;
-        decl->ds = ds;
-        if (declarator* d = parse_declarator())
-        {
-            decl->d.push_back(d);
-            while (check(","))
-                decl->d.push_back(accept(parse_declarator()));
-        }
-
-        // maybe its a function definition
-        if (!check(";"))
+        initializer* in = make<initializer>();
+        in->tok = tok;
+        while (!check(TK_RBRACE))
         {
-            tokit = old;
-            delete decl;
-            return nullptr;
-        }
-
-        if (ds->sus) ds->type = register_type(ds->sus);
-        // you can do struct x; but not int;
-        if (!ds->sus && decl->d.empty())
-            reject(1);
-
-        for (declarator* d : decl->d)
-        {
-            auto& table = scopes.back()->vars;
-            token identifier = d->get_identifier();
-            if (d->dd->is_identifier() || d->dd->is_definition())
+            in->list.push_back(accept(parse_initializer()));
+            if (!check(TK_COMMA))
             {
-                // TOOD: check which tag (union or struct)
-                if (ds->sus)
-                {
-                    if (!d->is_pointer() && !find_tag(ds->sus->id.str)->is_complete)
-                        error::reject(identifier); // incomplete type
-                }
-
-                if (table.find(identifier.str) != table.end())
-                    error::reject(identifier); // redefinition
-
-                Type *type = d->gen_type(ds->type);
-                table[identifier.str] = new variable_object(type);
-            }
-            else
-            {
-                auto table_elem = table.find(identifier.str);
-                if (table_elem != table.end())
-                {
-                    if (dynamic_cast<variable_object*>(table_elem->second))
-                        error::reject(identifier); // redeclaration as different kind
-                }
-                else
-                {
-                    function_object *fo = new function_object(false);
-                    fo->type = (FunctionType*)d->gen_type(ds->type);
-                    table[identifier.str] = fo;
-                }
+                accepts(TK_RBRACE);
+                break;
             }
         }
-        return decl;
+        return in;
     }
-    return nullptr;
+
+    expression* expr = parse_assignment_expression();
+    if (!expr)
+        return nullptr;
+    initializer* in = make<initializer>();
+    in->tok = tok;
+    in->expr = expr;
+    return in;
 }
 
 pair<Type*, struct_or_union_specifier*> parser::handle_type_specifiers(vector<type_specifier*>& tsps)
@@ -660,8 +545,9 @@ pair<Type*, struct_or_union_specifier*> parser::handle_type_specifiers(vector<ty
 
 declaration_specifiers* parser::parse_declaration_specifiers()
 {
-    vector<declspec*> declspecs;
+    avector<declspec*> declspecs;
     vector<type_specifier*> tsps;
+    bool is_static = false, is_extern = false, is_inline = false;
     token tok = *tokit;
     while (true)
     {
@@ -679,11 +565,20 @@ declaration_specifiers* parser::parse_declaration_specifiers()
         if (function_specifier* fs = parse_function_specifier())
         {
             declspecs.push_back(fs);
+            is_inline |= fs->tok.kind == KW_INLINE;
             continue;
         }
         if (storage_class_specifier* ss = parse_storage_class_specifier())
         {
             declspecs.push_back(ss);
+            if (ss->tok.kind == KW_STATIC || ss->tok.kind == KW_EXTERN)
+            {
+                // one of them, once
+                if (is_static || is_extern)
+                    error::reject(ss->tok);
+                is_static = ss->tok.kind == KW_STATIC;
+                is_extern = ss->tok.kind == KW_EXTERN;
+            }
             continue;
         }
         break;
@@ -691,21 +586,21 @@ declaration_specifiers* parser::parse_declaration_specifiers()
     if (declspecs.empty())
         return nullptr;
 
-    declaration_specifiers* ds = new declaration_specifiers;
+    declaration_specifiers* ds = make<declaration_specifiers>();
     ds->tok = tok;
     ds->declspecs = declspecs;
+    ds->is_static = is_static;
+    ds->is_extern = is_extern;
+    ds->is_inline = is_inline;
     tie(ds->type, ds->sus) = handle_type_specifiers(tsps);
     return ds;
 }
 
 storage_class_specifier* parser::parse_storage_class_specifier()
 {
-    static const vector<string> specifiers = {
-        "typedef", "extern", "static", "_Thread_local", "auto", "register"
-    };
-    if (check_any(specifiers))
+    if (is_storage_class_specifier(tokit->kind))
     {
-        storage_class_specifier* ss = new storage_class_specifier;
+        storage_class_specifier* ss = make<storage_class_specifier>();
         ss->tok = parse_token();
         return ss;
     }
@@ -714,13 +609,9 @@ storage_class_specifier* parser::parse_storage_class_specifier()
 
 type_specifier* parser::parse_type_specifier()
 {
-    static const vector<string> builtin_types = {
-        "void", "char", "short", "int", "long", "float", "double",
-        "signed", "unsigned", "_Bool", "_Complex"
-    };
-    if (check_any(builtin_types))
+    if (is_builtin_type(tokit->kind))
     {
-        builtin_type_specifier* ts = new builtin_type_specifier;
+        builtin_type_specifier* ts = make<builtin_type_specifier>();
         ts->tok = parse_token();
         return ts;
     }
@@ -731,28 +622,28 @@ type_specifier* parser::parse_type_specifier()
 
 struct_or_union_specifier* parser::parse_struct_or_union_specifier()
 {
-    if (check_any({"struct", "union"}))
+    if (tokit->kind == KW_STRUCT || tokit->kind == KW_UNION)
     {
-        struct_or_union_specifier* ss = new struct_or_union_specifier;
+        struct_or_union_specifier* ss = make<struct_or_union_specifier>();
         ss->sou = parse_token();
-        if (check("{"))
+        if (check(TK_LBRACE))
         {
             ss->has_sds = true;
             ss->sds = parse_struct_declaration_list();
             if (ss->sds.empty())
                 reject();
-            accepts("}");
+            accepts(TK_RBRACE);
         }
         else
         {
             ss->id = parse_identifier();
-            if (check("{"))
+            if (check(TK_LBRACE))
             {
                 ss->has_sds = true;
                 ss->sds = parse_struct_declaration_list();
                 if (ss->sds.empty())
                     reject();
-                accepts("}");
+                accepts(TK_RBRACE);
             }
         }
         return ss;
@@ -763,7 +654,7 @@ struct_or_union_specifier* parser::parse_struct_or_union_specifier()
 struct_declaration* parser::parse_struct_declaration()
 {
     vector<type_specifier*> tss;
-    vector<specifier_qualifier*> sqs;
+    avector<specifier_qualifier*> sqs;
     while (true)
     {
         if (type_specifier* ts = parse_type_specifier())
@@ -782,24 +673,24 @@ struct_declaration* parser::parse_struct_declaration()
     if (sqs.empty())
         return nullptr;
 
-    struct_declaration* sd = new struct_declaration;
+    struct_declaration* sd = make<struct_declaration>();
     tie(sd->type, sd->sus) = handle_type_specifiers(tss);
     if (sd->sus) sd->type = register_type(sd->sus);
     sd->sqs = sqs;
     sd->ds = parse_struct_declarator_list();
     if (sd->ds.empty())
         reject();
-    accepts(";");
+    accepts(TK_SEMICOLON);
     return sd;
 }
 
-vector<declarator*> parser::parse_struct_declarator_list()
+avector<declarator*> parser::parse_struct_declarator_list()
 {
-    vector<declarator*> ds;
+    avector<declarator*> ds;
     if (declarator* d = parse_declarator())
     {
         ds.push_back(d);
-        while (check(","))
+        while (check(TK_COMMA))
             ds.push_back(accept(parse_declarator()));
     }
     for (declarator* dec : ds)
@@ -809,9 +700,9 @@ vector<declarator*> parser::parse_struct_declarator_list()
     return ds;
 }
 
-vector<struct_declaration*> parser::parse_struct_declaration_list()
+avector<struct_declaration*> parser::parse_struct_declaration_list()
 {
-    vector<struct_declaration*> sds;
+    avector<struct_declaration*> sds;
     while (struct_declaration* sd = parse_struct_declaration())
         sds.push_back(sd);
     return sds;
@@ -819,12 +710,9 @@ vector<struct_declaration*> parser::parse_struct_declaration_list()
 
 type_qualifier* parser::parse_type_qualifier()
 {
-    static const vector<string> qualifiers = {
-        "const", "restrict", "volatile", "_Atomic"
-    };
-    if (check_any(qualifiers))
+    if (is_type_qualifier(tokit->kind))
     {
-        type_qualifier* tq = new type_qualifier;
+        type_qualifier* tq = make<type_qualifier>();
         tq->tok = parse_token();
         return tq;
     }
@@ -833,80 +721,65 @@ type_qualifier* parser::parse_type_qualifier()
 
 function_specifier* parser::parse_function_specifier()
 {
-    static const vector<string> specifiers = {
-        "inline", "_Noreturn"
-    };
-    if (check_any(specifiers))
+    if (is_function_specifier(tokit->kind))
     {
-        function_specifier* fs = new function_specifier;
+        function_specifier* fs = make<function_specifier>();
         fs->tok = parse_token();
         return fs;
     }
     return nullptr;
 }
 
-declarator* parser::parse_declarator()
+// With may_be_abstract, as in parameter declarations, the identifier may be
+// left out; pointers alone then make the declarator.
+declarator* parser::parse_declarator(bool may_be_abstract)
 {
-    token_iter old = tokit;
-    vector<pointer*> ptrs = parse_pointer();
-    if (!ptrs.empty())
-    {
-        declarator* decl = new declarator;
-        decl->p = ptrs;
-        decl->dd = parse_direct_declarator();
-        if (!decl->dd)
-        {
-            tokit = old;
-            delete decl;
-            return nullptr;
-        }
-        return decl;
-    }
-    if (direct_declarator* dd = parse_direct_declarator())
+    avector<pointer*> ptrs = parse_pointer();
+    direct_declarator* dd = parse_direct_declarator(may_be_abstract);
+    if (!dd && (ptrs.empty() || !may_be_abstract))
     {
-        declarator* decl = new declarator;
-        decl->dd = dd;
-        return decl;
+        if (!ptrs.empty())
+            reject();
+        return nullptr;
     }
-    return nullptr;
+
+    declarator* decl = make<declarator>();
+    decl->p = ptrs;
+    decl->dd = dd;
+    return decl;
 }
 
-direct_declarator* parser::parse_nof_direct_declarator()
+direct_declarator* parser::parse_nof_direct_declarator(bool may_be_abstract)
 {
     if (check_identifier())
     {
-        direct_declarator* dd = new direct_declarator;
+        direct_declarator* dd = make<direct_declarator>();
         dd->tok = parse_identifier();
         return dd;
     }
-    token_iter old = tokit;
-    if (check("("))
+    // a parenthesis opening a parameter list belongs to an abstract declarator
+    if (tokit->kind == TK_LPAREN && !starts_parameter_list(tokit[1]))
     {
-        parenthesized_declarator* pd = new parenthesized_declarator;
-        pd->decl = parse_declarator();
-        if (!pd->decl)
-        {
-            tokit = old;
-            delete pd;
-            return nullptr;
-        }
-        accepts(")");
+        ++tokit;
+        parenthesized_declarator* pd = make<parenthesized_declarator>();
+        pd->decl = accept(parse_declarator(may_be_abstract));
+        accepts(TK_RPAREN);
         return pd;
     }
     return nullptr;
 }
 
-direct_declarator* parser::parse_direct_declarator()
+direct_declarator* parser::parse_direct_declarator(bool may_be_abstract)
 {
-    if (direct_declarator* dd = parse_nof_direct_declarator())
+    if (direct_declarator* dd = parse_nof_direct_declarator(may_be_abstract))
     {
-        if (check("("))
+        if (check(TK_LPAREN))
         {
-            function_declarator* fd = new function_declarator;
+            function_declarator* fd = make<function_declarator>();
             fd->op = prev_token();
             fd->dd = dd;
             fd->pl = parse_parameter_type_list();
-            accepts(")");
+            accepts(TK_RPAREN);
             return fd;
         }
         return dd;
@@ -914,15 +787,15 @@ direct_declarator* parser::parse_direct_declarator()
     return nullptr;
 }
 
-vector<parameter_declaration*> parser::parse_parameter_type_list()
+avector<parameter_declaration*> parser::parse_parameter_type_list()
 {
-    vector<parameter_declaration*> pl;
+    avector<parameter_declaration*> pl;
     if (parameter_declaration* pd = parse_parameter_declaration())
     {
         pl.push_back(pd);
-        while (check(","))
+        while (check(TK_COMMA))
         {
-            if (check("..."))
+            if (check(TK_ELLIPSIS))
             {
                 pl.push_back(nullptr);
                 return pl;
@@ -933,12 +806,12 @@ vector<parameter_declaration*> parser::parse_parameter_type_list()
     return pl;
 }
 
-vector<pointer*> parser::parse_pointer()
+avector<pointer*> parser::parse_pointer()
 {
-    vector<pointer*> ptrs;
-    while (check("*"))
+    avector<pointer*> ptrs;
+    while (check(TK_STAR))
     {
-        pointer *p = new pointer;
+        pointer *p = make<pointer>();
         while (type_qualifier* tq = parse_type_qualifier())
             p->tql.push_back(tq);
         ptrs.push_back(p);
@@ -948,11 +821,11 @@ vector<pointer*> parser::parse_pointer()
 
 direct_declarator* parser::parse_nof_direct_abstract_declarator()
 {
-    if (check("("))
+    if (check(TK_LPAREN))
     {
-        parenthesized_declarator* pd = new parenthesized_declarator;
+        parenthesized_declarator* pd = make<parenthesized_declarator>();
         pd->decl = accept(parse_abstract_declarator());
-        accepts(")");
+        accepts(TK_RPAREN);
         return pd;
     }
     return nullptr;
@@ -962,13 +835,13 @@ direct_declarator* parser::parse_direct_abstract_declarator()
 {
     if (direct_declarator* dd = parse_nof_direct_abstract_declarator())
     {
-        if (check("("))
+        if (check(TK_LPAREN))
         {
-            function_declarator* fd = new function_declarator;
+            function_declarator* fd = make<function_declarator>();
             fd->op = prev_token();
             fd->dd = dd;
             fd->pl = parse_parameter_type_list();
-            accepts(")");
+            accepts(TK_RPAREN);
             return fd;
         }
         return dd;
@@ -978,10 +851,10 @@ direct_declarator* parser::parse_direct_abstract_declarator()
 
 declarator* parser::parse_abstract_declarator()
 {
-    vector<pointer*> ptrs = parse_pointer();
+    avector<pointer*> ptrs = parse_pointer();
     if (!ptrs.empty())
     {
-        declarator* ad = new declarator;
+        declarator* ad = make<declarator>();
         ad->p = ptrs;
         if (direct_declarator* dad = parse_direct_abstract_declarator())
             ad->dd = dad;
@@ -989,7 +862,7 @@ declarator* parser::parse_abstract_declarator()
     }
     else if (direct_declarator* dad = parse_direct_abstract_declarator())
     {
-        declarator* ad = new declarator;
+        declarator* ad = make<declarator>();
         ad->dd = dad;
         return ad;
     }
@@ -998,7 +871,7 @@ declarator* parser::parse_abstract_declarator()
 
 type_name* parser::parse_type_name()
 {
-    vector<specifier_qualifier*> sqs;
+    avector<specifier_qualifier*> sqs;
     vector<type_specifier*> tss;
     while (true)
     {
@@ -1018,7 +891,7 @@ type_name* parser::parse_type_name()
     if (sqs.empty())
         return nullptr;
 
-    type_name* tn = new type_name;
+    type_name* tn = make<type_name>();
     tn->sqs = sqs;
     tie(tn->type, tn->sus) = handle_type_specifiers(tss);
     if (tn->sus) tn->type = register_type(tn->sus);
@@ -1031,13 +904,10 @@ parameter_declaration* parser::parse_parameter_declaration()
 {
     if (declaration_specifiers* ds = parse_declaration_specifiers())
     {
-        parameter_declaration* pd = new parameter_declaration;
+        parameter_declaration* pd = make<parameter_declaration>();
         pd->ds = ds;
         if (ds->sus) ds->type = register_type(ds->sus);
-        if (declarator* decl = parse_declarator())
-            pd->decl = decl;
-        else
-            pd->decl = parse_abstract_declarator();
+        pd->decl = parse_declarator(true);
         return pd;
     }
     return nullptr;
@@ -1062,43 +932,44 @@ statement* parser::parse_statement()
 
 labeled_statement* parser::parse_labeled_statement()
 {
-    if (check_identifier())
+    if (check_identifier() && tokit[1].kind == TK_COLON)
     {
         token id = parse_identifier();
-        if (!check(":"))
-        {
-            tokit--;
-            return nullptr;
-        }
-        goto_label* gl = new goto_label;
+        ++tokit;
+        goto_label* gl = make<goto_label>();
         gl->id = id;
 
         auto& labels = current_function->labels;
-        auto it = labels.find(id.str);
+        auto it = labels.find(id.sym);
         if (it != labels.end())
             error::reject(id);
 
         gl->stat = accept(parse_statement());
-        return labels[id.str] = gl;
+        labels[id.sym] = gl;
+        return gl;
     }
-    if (check("case"))
+    if (check(KW_CASE))
     {
         if (!current_switch)
             reject(1);
 
-        case_label* cl = new case_label;
+        case_label* cl = make<case_label>();
+        cl->tok = prev_token();
         cl->ce = accept(parse_constant_expression());
-        accepts(":");
+        if (!cl->ce->value)
+            error::reject(cl->tok);
+        current_switch->cases.push_back(cl);
+        accepts(TK_COLON);
         cl->stat = accept(parse_statement());
         return cl;
     }
-    if (check("default"))
+    if (check(KW_DEFAULT))
     {
-        if (!current_switch)
+        if (!current_switch || current_switch->dflt)
             reject(1);
 
-        default_label* dl = new default_label;
-        accepts(":");
+        default_label* dl = current_switch->dflt = make<default_label>();
+        accepts(TK_COLON);
         dl->stat = accept(parse_statement());
         return dl;
     }
@@ -1107,13 +978,13 @@ labeled_statement* parser::parse_labeled_statement()
 
 compound_statement* parser::parse_compound_statement(bool open_scope)
 {
-    if (check("{"))
+    if (check(TK_LBRACE))
     {
-        compound_statement* cs = new compound_statement;
-        if (open_scope) scopes.push_back(cs->sc = new scope(false));
-        while (!check("}"))
+        compound_statement* cs = make<compound_statement>();
+        if (open_scope) cu->scopes.push_back(make<scope>(false));
+        while (!check(TK_RBRACE))
             cs->bi.push_back(accept(parse_block_item()));
-        if (open_scope) scopes.pop_back();
+        if (open_scope) cu->scopes.pop_back();
         return cs;
     }
     return nullptr;
@@ -1123,13 +994,13 @@ block_item* parser::parse_block_item()
 {
     if (declaration* decl = parse_declaration())
     {
-        declaration_item* di = new declaration_item;
+        declaration_item* di = make<declaration_item>();
         di->decl = decl;
         return di;
     }
     if (statement* stat = parse_statement())
     {
-        statement_item* si = new statement_item;
+        statement_item* si = make<statement_item>();
         si->stat = stat;
         return si;
     }
@@ -1140,37 +1011,37 @@ expression_statement* parser::parse_expression_statement()
 {
     if (expression* expr = parse_expression())
     {
-        expression_statement* es = new expression_statement;
+        expression_statement* es = make<expression_statement>();
         es->expr = expr;
-        accepts(";");
+        accepts(TK_SEMICOLON);
         return es;
     }
-    if (check(";"))
-        return new expression_statement;
+    if (check(TK_SEMICOLON))
+        return make<expression_statement>();
     return nullptr;
 }
 
 selection_statement* parser::parse_selection_statement()
 {
-    if (check("if"))
+    if (check(KW_IF))
     {
-        if_statement* is = new if_statement;
-        accepts("(");
+        if_statement* is = make<if_statement>();
+        accepts(TK_LPAREN);
         is->op = *tokit;
         is->expr = accept(parse_expression());
-        accepts(")");
+        accepts(TK_RPAREN);
         is->stat = accept(parse_statement());
-        if (check("else"))
+        if (check(KW_ELSE))
             is->estat = accept(parse_statement());
         return is;
     }
-    if (check("switch"))
+    if (check(KW_SWITCH))
     {
-        switch_statement* ss = new switch_statement;
-        accepts("(");
+        switch_statement* ss = make<switch_statement>();
+        accepts(TK_LPAREN);
         ss->op = *tokit;
         ss->expr = accept(parse_expression());
-        accepts(")");
+        accepts(TK_RPAREN);
         switch_statement* old_switch = current_switch;
         current_switch = ss;
         ss->stat = accept(parse_statement());
@@ -1182,45 +1053,45 @@ selection_statement* parser::parse_selection_statement()
 
 iteration_statement* parser::parse_iteration_statement()
 {
-    if (check("while"))
+    if (check(KW_WHILE))
     {
-        while_statement* ws = new while_statement;
-        accepts("(");
+        while_statement* ws = make<while_statement>();
+        accepts(TK_LPAREN);
         ws->op = *tokit;
         ws->expr = accept(parse_expression());
-        accepts(")");
+        accepts(TK_RPAREN);
         iteration_statement* old_loop = current_loop;
         current_loop = ws;
         ws->stat = accept(parse_statement());
         current_loop = old_loop;
         return ws;
     }
-    if (check("do"))
+    if (check(KW_DO))
     {
-        do_while_statement* dws = new do_while_statement;
+        do_while_statement* dws = make<do_while_statement>();
         iteration_statement* old_loop = current_loop;
         current_loop = dws;
         dws->stat = accept(parse_statement());
         current_loop = old_loop;
-        accepts("while");
-        accepts("(");
+        accepts(KW_WHILE);
+        accepts(TK_LPAREN);
         dws->op = *tokit;
         dws->expr = accept(parse_expression());
-        accepts(")");
-        accepts(";");
+        accepts(TK_RPAREN);
+        accepts(TK_SEMICOLON);
         return dws;
     }
-    if (check("for"))
+    if (check(KW_FOR))
     {
-        for_statement* fs = new for_statement;
-        accepts("(");
+        for_statement* fs = make<for_statement>();
+        accepts(TK_LPAREN);
         fs->expr1 = parse_expression();
-        accepts(";");
+        accepts(TK_SEMICOLON);
         fs->op = *tokit;
         fs->expr2 = parse_expression();
-        accepts(";");
+        accepts(TK_SEMICOLON);
         fs->expr3 = parse_expression();
-        accepts(")");
+        accepts(TK_RPAREN);
         iteration_statement* old_loop = current_loop;
         current_loop = fs;
         fs->stat = accept(parse_statement());
@@ -1232,51 +1103,49 @@ iteration_statement* parser::parse_iteration_statement()
 
 jump_statement* parser::parse_jump_statement()
 {
-    if (check("goto"))
+    if (check(KW_GOTO))
     {
-        goto_statement* gs = new goto_statement;
+        goto_statement* gs = make<goto_statement>();
         gs->id = parse_identifier();
-        accepts(";");
+        accepts(TK_SEMICOLON);
         current_function->gotos.push_back(gs);
         return gs;
     }
-    if (check("continue"))
+    if (check(KW_CONTINUE))
     {
         if (!current_loop)
             reject(1);
 
-        continue_statement* cs = new continue_statement;
-        accepts(";");
+        continue_statement* cs = make<continue_statement>();
+        accepts(TK_SEMICOLON);
         return cs;
     }
-    if (check("break"))
+    if (check(KW_BREAK))
     {
         if (!current_loop && !current_switch)
             reject(1);
 
-        break_statement* bs = new break_statement;
-        accepts(";");
+        break_statement* bs = make<break_statement>();
+        accepts(TK_SEMICOLON);
         return bs;
     }
-    if (check("return"))
+    if (check(KW_RETURN))
     {
-        return_statement* rs = new return_statement;
+        return_statement* rs = make<return_statement>();
         rs->nxt = *tokit;
         rs->expr = parse_expression();
-        accepts(";");
+        accepts(TK_SEMICOLON);
         return rs;
     }
     return nullptr;
 }
 
-function_definition* parser::parse_function_definition()
+// Binds the function fd defines and its parameters, the latter in the scope
+// just opened for them.
+void parser::bind_function_definition(function_definition* fd)
 {
-    function_definition* fd = current_function = new function_definition;
-    fd->ds = accept(parse_declaration_specifiers());
-    if (fd->ds->sus) fd->ds->type = register_type(fd->ds->sus);
-    scopes.push_back(fd->sc = new scope(false));
-    fd->dec = accept(parse_declarator());
-
+    phase_timer timer(PHASE_SEMA);
+    declaration_specifiers* ds = fd->ds;
     declarator* decl = fd->dec->unparenthesize();
     function_declarator* fdecl = dynamic_cast<function_declarator*>(decl->dd);
     if (!fdecl)
@@ -1288,25 +1157,28 @@ function_definition* parser::parse_function_definition()
     if (decl->p.empty())
     {
         struct_or_union_specifier* ss = fd->ds->sus;
-        if (ss && !find_tag(ss->id.str)->is_complete)
+        if (ss && !find_tag(ss->id.sym)->is_complete)
             error::reject(identifier);
     }
 
-    auto& table = scopes.front()->vars;
-    auto table_elem = table.find(identifier.str);
+    auto& table = cu->scopes.front()->vars;
+    auto table_elem = table.find(identifier.sym);
     if (table_elem != table.end())
     {
-        function_object* fnc = dynamic_cast<function_object*>(table_elem->second);
-        if (fnc == nullptr || fnc->is_defined)
+        object* o = table_elem->second;
+        if (o->kind != OBJECT_FUNCTION || ((function_object*)o)->is_defined)
             error::reject(identifier); // redefinicija
         else
-            fnc->is_defined = true; // definicija deklariranog
+            ((function_object*)o)->is_defined = true; // definicija deklariranog
+        fd->dec->obj = o;
+        link_function((function_object*)o, ds, false, true, identifier);
     }
     else
     {
-        function_object* fo = new function_object(true);
+        function_object* fo = make<function_object>(true);
         fo->type = (FunctionType*)fd->dec->gen_type(fd->ds->type);
-        table[identifier.str] = fo;
+        table.emplace(identifier.sym, fd->dec->obj = fo);
+        link_function(fo, ds, true, true, identifier);
     }
 
     if (!fdecl->is_noparam())
@@ -1321,51 +1193,65 @@ function_definition* parser::parse_function_definition()
                 error::reject(pard->ds->tok);
 
             declarator* decl = pard->decl;
-            auto& table = scopes.back()->vars;
+            auto& table = cu->scopes.back()->vars;
             token identifier = decl->get_identifier();
             if (decl->dd->is_identifier() || decl->dd->is_definition())
             {
-                if (table.find(identifier.str) != table.end())
+                if (table.find(identifier.sym) != table.end())
                     error::reject(identifier); // redefinicija
 
                 Type *type = decl->gen_type(pard->ds->type);
-                table[identifier.str] = new variable_object(type);
+                table.emplace(identifier.sym,
+                              decl->obj = make<variable_object>(type, false));
             }
             else
                 reject(); // deklaracija | TOOD: je li ovo zbilja error?
         }
     }
+}
+
+function_definition* parser::parse_function_definition(declaration_specifiers* ds, declarator* dec)
+{
+    function_definition* fd = current_function = make<function_definition>();
+    fd->ds = ds;
+    cu->scopes.push_back(make<scope>(false));
+    fd->dec = dec;
+    bind_function_definition(fd);
 
     fd->cs = accept(parse_compound_statement(false));
     fd->resolve_gotos();
-    scopes.pop_back();
+    cu->scopes.pop_back();
     current_function = nullptr;
     return fd;
 }
 
 external_declaration* parser::parse_external_declaration()
 {
-    if (declaration* decl = parse_declaration())
-    {
-        external_declaration* ed = new external_declaration;
-        ed->decl = decl;
-        return ed;
-    }
-    if (function_definition* fd = parse_function_definition())
-    {
-        external_declaration* ed = new external_declaration;
-        ed->fd = fd;
-        return ed;
-    }
-    return nullptr;
+    declaration_specifiers* ds = parse_declaration_specifiers();
+    if (!ds)
+        return nullptr;
+    if (ds->sus) ds->type = register_type(ds->sus);
+
+    // the token after the first declarator tells a definition apart
+    external_declaration* ed = make<external_declaration>();
+    declarator* d = parse_declarator();
+    if (d && tokit->kind == TK_LBRACE)
+        ed->fd = parse_function_definition(ds, d);
+    else
+        ed->decl = parse_declaration(ds, d);
+    return ed;
 }
 
-translation_unit* parser::parse_translation_unit()
+translation_unit* parser::parse_translation_unit(translation_unit* root)
 {
-    translation_unit* root = new translation_unit;
-    scopes.push_back(root->sc = new scope(true));
+    if (!root)
+    {
+        root = make<translation_unit>();
+        root->sc = make<scope>(true);
+    }
+    cu->scopes.push_back(root->sc);
     while (tokit->type != END_OF_FILE)
         root->ed.push_back(accept(parse_external_declaration()));
-    scopes.pop_back();
+    cu->scopes.pop_back();
     return root;
 }
@@ -1,41 +1,27 @@
 #pragma once
 #include "ast.h"
 
-using token_iter = vector<token>::iterator;
-
 class parser
 {
 public:
-    parser(vector<token>& tokens) : tokens(tokens), tokit(tokens.begin())
+    parser(token_stream& tokens) : tokit{&tokens, 0}
     {
     }
 
-    translation_unit* parse()
+    // Into root if given, a unit already holding the declarations of a
+    // precompiled header.
+    translation_unit* parse(translation_unit* root = nullptr)
     {
-        return parse_translation_unit();
+        return parse_translation_unit(root);
     }
 
 private:
-    vector<token>& tokens;
-    token_iter tokit;
+    token_cursor tokit;
 
     function_definition* current_function = nullptr;
     iteration_statement* current_loop = nullptr;
     switch_statement* current_switch = nullptr;
 
-    string get_digraph(const string& str)
-    {
-        static const map<string, string> digraphs =
-            {
-                {"[", "<:"}, {"]", ":>"}, {"{", "<%"},
-                {"}", "%>"}, {"#", "%:"}, {"##", "%:%:"}
-            };
-        auto it = digraphs.find(str);
-        if (it != digraphs.end())
-            return it->second;
-        return str;
-    }
-
     token prev_token()
     {
         tokit--;
@@ -44,22 +30,14 @@ private:
         return tok;
     }
 
-    bool check(const string& what)
+    bool check(token_kind what)
     {
-        if (tokit->str != what && tokit->str != get_digraph(what))
+        if (tokit->kind != what)
             return false;
         return ++tokit, true;
     }
 
-    bool check_any(const vector<string>& what)
-    {
-        for (const string& s : what)
-            if (check(s))
-                return --tokit, true;
-        return false;
-    }
-
-    void accepts(const string& what)
+    void accepts(token_kind what)
     {
         if (!check(what))
             reject();
@@ -72,14 +50,6 @@ private:
         return ptr;
     }
 
-    void accept_any(const vector<string>& what)
-    {
-        for (const string& s : what)
-            if (check(s))
-                return;
-        reject();
-    }
-
     void reject(int rollback = 0)
     {
         while (rollback--)
@@ -108,30 +78,36 @@ private:
         return *tokit++;
     }
 
+    // One token of lookahead is enough to pick between a parenthesized
+    // expression and a cast, or a parenthesized declarator and a parameter
+    // list.
+    bool starts_type_name(const token& tok);
+    bool starts_declaration_specifiers(const token& tok);
+
+    bool starts_parameter_list(const token& tok)
+    {
+        return tok.kind == TK_RPAREN || starts_declaration_specifiers(tok);
+    }
+
     pair<Type*, struct_or_union_specifier*> handle_type_specifiers(vector<type_specifier*>& tsps);
 
     expression* parse_expression();
-    primary_expression* parse_primary_expression();
-    postfix_expression* parse_postfix_expression();
-    unary_expression* parse_unary_expression();
-    cast_expression* parse_cast_expression();
-    multiplicative_expression* parse_multiplicative_expression();
-    additive_expression* parse_additive_expression();
-    shift_expression* parse_shift_expression();
-    relational_expression* parse_relational_expression();
-    equality_expression* parse_equality_expression();
-    and_expression* parse_and_expression();
-    exclusive_or_expression* parse_exclusive_or_expression();
-    inclusive_or_expression* parse_inclusive_or_expression();
-    logical_and_expression* parse_logical_and_expression();
-    logical_or_expression* parse_logical_or_expression();
-    conditional_expression* parse_conditional_expression();
-    assignment_expression* parse_assignment_expression();
-    constant_expression* parse_constant_expression();
+    expression* parse_primary_expression();
+    expression* parse_postfix_expression();
+    expression* parse_unary_expression();
+    expression* parse_cast_expression();
+    expression* parse_binary_expression(int min_precedence);
+    expression* parse_conditional_expression();
+    expression* parse_assignment_expression();
+    expression* parse_constant_expression();
 
     function_specifier* parse_function_specifier();
     storage_class_specifier* parse_storage_class_specifier();
     declaration* parse_declaration();
+    declaration* parse_declaration(declaration_specifiers* ds, declarator* first);
+    void bind_declarator(declaration_specifiers* ds, declarator* d);
+    declarator* parse_init_declarator(declaration_specifiers* ds, declarator* d);
+    initializer* parse_initializer();
     labeled_statement* parse_labeled_statement();
     expression_statement* parse_expression_statement();
     selection_statement* parse_selection_statement();
@@ -142,22 +118,23 @@ private:
     type_specifier* parse_type_specifier();
     struct_or_union_specifier* parse_struct_or_union_specifier();
     struct_declaration* parse_struct_declaration();
-    vector<declarator*> parse_struct_declarator_list();
-    vector<struct_declaration*> parse_struct_declaration_list();
+    avector<declarator*> parse_struct_declarator_list();
+    avector<struct_declaration*> parse_struct_declaration_list();
     direct_declarator* parse_nof_direct_abstract_declarator();
     direct_declarator* parse_direct_abstract_declarator();
     declarator* parse_abstract_declarator();
     type_name* parse_type_name();
     declaration_specifiers* parse_declaration_specifiers();
-    vector<parameter_declaration*> parse_parameter_type_list();
-    vector<pointer*> parse_pointer();
+    avector<parameter_declaration*> parse_parameter_type_list();
+    avector<pointer*> parse_pointer();
     parameter_declaration* parse_parameter_declaration();
-    direct_declarator* parse_nof_direct_declarator();
-    direct_declarator* parse_direct_declarator();
-    declarator* parse_declarator();
+    direct_declarator* parse_nof_direct_declarator(bool may_be_abstract);
+    direct_declarator* parse_direct_declarator(bool may_be_abstract);
+    declarator* parse_declarator(bool may_be_abstract = false);
     block_item* parse_block_item();
     compound_statement* parse_compound_statement(bool open_scope);
-    function_definition* parse_function_definition();
+    void bind_function_definition(function_definition* fd);
+    function_definition* parse_function_definition(declaration_specifiers* ds, declarator* dec);
     external_declaration* parse_external_declaration();
-    translation_unit* parse_translation_unit();
+    translation_unit* parse_translation_unit(translation_unit* root);
 };
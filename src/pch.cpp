@@ -0,0 +1,635 @@
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <unordered_set>
+#include <sys/stat.h>
+#include "compilation.h"
+#include "pch.h"
+#include "preprocess.h"
+#include "llvm/Support/xxhash.h"
+using namespace std;
+
+// Changed whenever the layout below does.
+static const char magic[8] = {'c', '4', 'p', 'c', 'h', 0, 0, 2};
+
+// The file, in native byte order, after magic and a hash of the rest:
+//   files      count, then path, mtime seconds and nanoseconds, size
+//   tags       count; each is created up front, so that types can name it
+//   types      count, then a type_code and its operands, parts first
+//   tag bodies complete flag, member types, member names and indices
+//   tag names  count, then the name and tag of each in the file scope
+//   objects    count, then kind, name, type and object_flags, in
+//              declaration order
+//   macros     the names they use, the text their tokens spell, then each
+//              macro with its tokens rebased to that text
+//   once       count, then the paths of files marked #pragma once
+enum type_code : uint32_t
+{
+    TC_VOID,
+    TC_INT,      // bits
+    TC_FLOAT,
+    TC_DOUBLE,
+    TC_FP128,
+    TC_POINTER,  // pointee
+    TC_ARRAY,    // element, 64-bit length
+    TC_FUNCTION, // vararg, parameter count, return type, parameters
+    TC_STRUCT    // tag
+};
+
+enum object_flags : uint32_t
+{
+    OF_INTERNAL = 1,
+    OF_DEFINED = 2,    // variables, tentatively
+    OF_INLINE_ONLY = 4 // functions
+};
+
+struct writer
+{
+    void u32(uint32_t v)
+    {
+        out.append((const char*)&v, sizeof v);
+    }
+
+    void u64(uint64_t v)
+    {
+        out.append((const char*)&v, sizeof v);
+    }
+
+    void str(string_view s)
+    {
+        u32(s.size());
+        out.append(s);
+    }
+
+    string out;
+};
+
+// Numbers types in the order they are first met, each after the types it is
+// made of. A struct is written as its tag, whose body comes later, so that
+// self-referencing structs need no special case.
+struct type_table
+{
+    type_table(const unordered_map<StructType*, uint32_t>& tags) : tags(tags)
+    {
+    }
+
+    uint32_t id(Type* t);
+
+    const unordered_map<StructType*, uint32_t>& tags;
+    unordered_map<Type*, uint32_t> ids;
+    writer w;
+};
+
+uint32_t type_table::id(Type* t)
+{
+    auto it = ids.find(t);
+    if (it != ids.end())
+        return it->second;
+
+    vector<uint32_t> parts;
+    if (t->isPointerTy() || t->isArrayTy())
+        parts.push_back(id(t->getContainedType(0)));
+    else if (t->isFunctionTy())
+        for (Type* part : t->subtypes())
+            parts.push_back(id(part));
+
+    if (t->isVoidTy())
+        w.u32(TC_VOID);
+    else if (t->isIntegerTy())
+    {
+        w.u32(TC_INT);
+        w.u32(t->getIntegerBitWidth());
+    }
+    else if (t->isFloatTy())
+        w.u32(TC_FLOAT);
+    else if (t->isDoubleTy())
+        w.u32(TC_DOUBLE);
+    else if (t->isFP128Ty())
+        w.u32(TC_FP128);
+    else if (t->isPointerTy())
+    {
+        w.u32(TC_POINTER);
+        w.u32(parts[0]);
+    }
+    else if (t->isArrayTy())
+    {
+        w.u32(TC_ARRAY);
+        w.u32(parts[0]);
+        w.u64(t->getArrayNumElements());
+    }
+    else if (t->isFunctionTy())
+    {
+        w.u32(TC_FUNCTION);
+        w.u32(((FunctionType*)t)->isVarArg());
+        w.u32(parts.size() - 1);
+        for (uint32_t part : parts)
+            w.u32(part);
+    }
+    else
+    {
+        w.u32(TC_STRUCT);
+        w.u32(tags.at((StructType*)t));
+    }
+
+    uint32_t next = ids.size();
+    ids.emplace(t, next);
+    return next;
+}
+
+// Macros are saved already tokenized, so that reading them back is no
+// more than rebasing offsets and interning names. Each token's symbol is
+// replaced by its place in the name table, counting from 1.
+static void write_macros(writer& w, const preprocessor& pp)
+{
+    writer names, defs;
+    unordered_map<uint32_t, uint32_t> name_ids;
+    auto name_id = [&](symbol name) -> uint32_t
+    {
+        if (!name.id)
+            return 0;
+        auto [it, fresh] = name_ids.emplace(name.id, name_ids.size() + 1);
+        if (fresh)
+            names.str(name.str());
+        return it->second;
+    };
+
+    string text;
+    uint32_t count = 0;
+    const vector<unique_ptr<macro>>& macros = pp.defined_macros();
+    for (size_t id = 0; id < macros.size(); ++id)
+    {
+        const macro* m = macros[id].get();
+        if (!m)
+            continue;
+        ++count;
+        defs.u32(name_id(symbol(uint32_t(id))));
+        defs.u32(m->function_like | m->variadic << 1);
+        defs.u32(m->params.size());
+        for (symbol param : m->params)
+            defs.u32(name_id(param));
+        defs.u32(m->body.size());
+        for (size_t i = 0; i < m->body.size(); ++i)
+        {
+            // spaced as written, which stringizing an argument relies on
+            const token& tok = m->body[i];
+            const token* prev = i ? &m->body[i - 1] : nullptr;
+            if (prev && tok.offset != prev->offset + prev->length)
+                text += ' ';
+            token saved = tok;
+            saved.offset = text.size();
+            saved.sym = symbol(name_id(tok.sym));
+            text += tok.str();
+            defs.out.append((const char*)&saved, sizeof saved);
+        }
+        text += '\n';
+    }
+
+    w.u32(name_ids.size());
+    w.out += names.out;
+    w.str(text);
+    w.u32(count);
+    w.out += defs.out;
+}
+
+bool write_pch(const string& path, translation_unit* tu, token_stream& tokens,
+               ostream& err)
+{
+    // the objects in the order their declarations come, so that codegen
+    // declares them as it would reading the header
+    vector<pair<symbol, object*>> objects(tu->imported.begin(),
+                                          tu->imported.end());
+    unordered_set<symbol> seen;
+    for (auto& imported : objects)
+        seen.insert(imported.first);
+    auto refuse = [&](const token& identifier)
+    {
+        err << "c4: cannot precompile '" << identifier.str() << "': headers "
+            << "may not define functions or initialize variables\n";
+        return false;
+    };
+    for (external_declaration* ed : tu->ed)
+    {
+        if (ed->fd)
+            return refuse(ed->fd->get_identifier());
+        for (declarator* d : ed->decl->d)
+        {
+            if (d->init)
+                return refuse(d->get_identifier());
+            symbol name = d->get_identifier().sym;
+            if (seen.insert(name).second)
+                objects.push_back({name, d->obj});
+        }
+    }
+
+    // tags in the order they were made, which names their struct types
+    vector<tag*> tags;
+    for (auto& [type, t] : cu->struct_tags)
+        tags.push_back(t);
+    std::sort(tags.begin(), tags.end(), [](tag* a, tag* b)
+    {
+        return a->id < b->id;
+    });
+    unordered_map<StructType*, uint32_t> tag_ids;
+    for (tag* t : tags)
+        tag_ids.emplace(t->type, tag_ids.size());
+
+    type_table types(tag_ids);
+    writer body;
+    for (tag* t : tags)
+    {
+        body.u32(t->is_complete);
+        body.u32(t->is_complete ? t->type->getNumElements() : 0);
+        if (t->is_complete)
+            for (Type* member : t->type->elements())
+                body.u32(types.id(member));
+        body.u32(t->indices.size());
+        for (auto& [name, index] : t->indices)
+        {
+            body.str(name.str());
+            body.u32(index);
+        }
+    }
+
+    body.u32(tu->sc->tags.size());
+    for (auto& [name, t] : tu->sc->tags)
+    {
+        body.str(name.str());
+        body.u32(tag_ids.at(t->type));
+    }
+
+    body.u32(objects.size());
+    for (auto& [name, o] : objects)
+    {
+        body.u32(o->kind);
+        body.str(name.str());
+        uint32_t flags = 0;
+        if (o->internal)
+            flags |= OF_INTERNAL;
+        if (o->kind == OBJECT_VARIABLE)
+        {
+            variable_object* vo = (variable_object*)o;
+            body.u32(types.id(vo->type));
+            if (vo->is_defined)
+                flags |= OF_DEFINED;
+        }
+        else
+        {
+            function_object* fo = (function_object*)o;
+            body.u32(types.id(fo->type));
+            if (fo->inline_only)
+                flags |= OF_INLINE_ONLY;
+        }
+        body.u32(flags);
+    }
+
+    preprocessor& pp = tokens.preprocessing();
+    write_macros(body, pp);
+    const vector<string>& once = pp.once_paths();
+    body.u32(once.size());
+    for (const string& header : once)
+        body.str(header);
+
+    writer head;
+    vector<string> files = tokens.files();
+    vector<pair<string, struct stat>> stats;
+    for (const string& file : files)
+    {
+        struct stat st;
+        if (stat(file.c_str(), &st) == 0)
+            stats.push_back({file, st});
+    }
+    head.u32(stats.size());
+    for (auto& [file, st] : stats)
+    {
+        head.str(file);
+        head.u64(st.st_mtim.tv_sec);
+        head.u32(st.st_mtim.tv_nsec);
+        head.u64(st.st_size);
+    }
+    head.u32(tags.size());
+    head.u32(types.ids.size());
+
+    string rest = head.out + types.w.out + body.out;
+    writer check;
+    check.out.append(magic, sizeof magic);
+    check.u64(xxHash64(rest));
+
+    ofstream out(path, ios::binary);
+    out << check.out << rest;
+    out.close();
+    if (!out)
+    {
+        err << path << ": cannot write file\n";
+        return false;
+    }
+    return true;
+}
+
+// Reads the mapped file front to back. Running past its end clears ok and
+// yields zeros, so the caller checks ok once a section is read.
+struct reader
+{
+    void take(void* v, size_t n)
+    {
+        if (size_t(end - p) < n)
+        {
+            ok = false;
+            memset(v, 0, n);
+            return;
+        }
+        memcpy(v, p, n);
+        p += n;
+    }
+
+    uint32_t u32()
+    {
+        uint32_t v;
+        take(&v, sizeof v);
+        return v;
+    }
+
+    uint64_t u64()
+    {
+        uint64_t v;
+        take(&v, sizeof v);
+        return v;
+    }
+
+    string_view str()
+    {
+        uint32_t n = u32();
+        if (size_t(end - p) < n)
+        {
+            ok = false;
+            return string_view();
+        }
+        string_view s(p, n);
+        p += n;
+        return s;
+    }
+
+    const char* p;
+    const char* end;
+    bool ok = true;
+};
+
+// The type written by type_table::id, or nullptr if it makes no sense.
+static Type* read_type(reader& r, const vector<Type*>& types,
+                       const vector<tag*>& tags)
+{
+    auto part = [&]() -> Type*
+    {
+        uint32_t id = r.u32();
+        return id < types.size() ? types[id] : nullptr;
+    };
+
+    LLVMContext& context = cu->context;
+    switch (r.u32())
+    {
+    case TC_VOID:
+        return Type::getVoidTy(context);
+    case TC_INT:
+    {
+        uint32_t bits = r.u32();
+        if (bits < 1 || bits > 128)
+            return nullptr;
+        return Type::getIntNTy(context, bits);
+    }
+    case TC_FLOAT:
+        return Type::getFloatTy(context);
+    case TC_DOUBLE:
+        return Type::getDoubleTy(context);
+    case TC_FP128:
+        return Type::getFP128Ty(context);
+    case TC_POINTER:
+    {
+        Type* pointee = part();
+        if (!pointee || !PointerType::isValidElementType(pointee))
+            return nullptr;
+        return PointerType::getUnqual(pointee);
+    }
+    case TC_ARRAY:
+    {
+        Type* element = part();
+        uint64_t length = r.u64();
+        if (!element || !ArrayType::isValidElementType(element))
+            return nullptr;
+        return ArrayType::get(element, length);
+    }
+    case TC_FUNCTION:
+    {
+        bool vararg = r.u32();
+        uint32_t count = r.u32();
+        Type* result = part();
+        if (!result || !FunctionType::isValidReturnType(result))
+            return nullptr;
+        vector<Type*> params;
+        for (uint32_t i = 0; i < count && r.ok; ++i)
+        {
+            Type* param = part();
+            if (!param || !FunctionType::isValidArgumentType(param))
+                return nullptr;
+            params.push_back(param);
+        }
+        return FunctionType::get(result, params, vararg);
+    }
+    case TC_STRUCT:
+    {
+        uint32_t id = r.u32();
+        return id < tags.size() ? tags[id]->type : nullptr;
+    }
+    default:
+        return nullptr;
+    }
+}
+
+// The macros saved by write_macros, their text added to the sources under
+// the name of the precompiled header.
+static bool read_macros(reader& r, preprocessor& pp, const string& path)
+{
+    vector<symbol> names(1);
+    for (uint32_t n = r.u32(); n && r.ok; --n)
+        names.push_back(intern(r.str()));
+    string_view text = r.str();
+    if (!r.ok)
+        return false;
+    uint32_t base = pp.add_buffer(path, text.data(), text.data() + text.size());
+    if (base == no_offset)
+        return false;
+
+    for (uint32_t n = r.u32(); n && r.ok; --n)
+    {
+        uint32_t name = r.u32();
+        uint32_t flags = r.u32();
+        auto m = make_unique<macro>();
+        m->function_like = flags & 1;
+        m->variadic = flags & 2;
+        m->params.resize(r.u32());
+        if (!r.ok || m->params.size() > size_t(r.end - r.p))
+            return false;
+        for (symbol& param : m->params)
+        {
+            uint32_t id = r.u32();
+            if (!id || id >= names.size())
+                return false;
+            param = names[id];
+        }
+        m->body.resize(r.u32());
+        if (!r.ok || m->body.size() > size_t(r.end - r.p) / sizeof(token))
+            return false;
+        for (token& tok : m->body)
+        {
+            r.take(&tok, sizeof tok);
+            if (tok.sym.id >= names.size() || tok.offset > text.size()
+                || tok.length > text.size() - tok.offset)
+                return false;
+            tok.offset += base;
+            tok.sym = names[tok.sym.id];
+        }
+        if (!name || name >= names.size())
+            return false;
+        pp.set_macro(names[name], move(m));
+    }
+    return r.ok;
+}
+
+static bool read_body(reader& r, translation_unit* tu, token_stream& tokens,
+                      const string& path)
+{
+    vector<tag*> tags(r.u32());
+    if (!r.ok || tags.size() > size_t(r.end - r.p))
+        return false;
+    for (tag*& t : tags)
+        t = make<tag>();
+
+    vector<Type*> types(r.u32());
+    if (!r.ok || types.size() > size_t(r.end - r.p))
+        return false;
+    for (size_t i = 0; i < types.size(); ++i)
+        if (!(types[i] = read_type(r, types, tags)))
+            return false;
+    auto type = [&]() -> Type*
+    {
+        uint32_t id = r.u32();
+        return id < types.size() ? types[id] : nullptr;
+    };
+
+    for (tag* t : tags)
+    {
+        bool complete = r.u32();
+        vector<Type*> members(r.u32());
+        if (!r.ok || members.size() > size_t(r.end - r.p))
+            return false;
+        for (Type*& member : members)
+            if (!(member = type()) || !StructType::isValidElementType(member))
+                return false;
+        if (complete)
+        {
+            t->type->setBody(members);
+            t->is_complete = true;
+        }
+        for (uint32_t n = r.u32(); n && r.ok; --n)
+        {
+            symbol name = intern(r.str());
+            t->indices.emplace(name, r.u32());
+        }
+    }
+
+    for (uint32_t n = r.u32(); n && r.ok; --n)
+    {
+        symbol name = intern(r.str());
+        uint32_t id = r.u32();
+        if (id >= tags.size())
+            return false;
+        tu->sc->tags.emplace(name, tags[id]);
+    }
+
+    for (uint32_t n = r.u32(); n && r.ok; --n)
+    {
+        object_kind kind = object_kind(r.u32());
+        symbol name = intern(r.str());
+        Type* t = type();
+        uint32_t flags = r.u32();
+        object* o;
+        if (!t)
+            return false;
+        if (kind == OBJECT_VARIABLE)
+        {
+            variable_object* vo = make<variable_object>(t, true);
+            vo->is_defined = flags & OF_DEFINED;
+            o = vo;
+        }
+        else if (kind == OBJECT_FUNCTION && t->isFunctionTy())
+        {
+            function_object* fo = make<function_object>(false);
+            fo->type = (FunctionType*)t;
+            fo->inline_only = flags & OF_INLINE_ONLY;
+            o = fo;
+        }
+        else
+            return false;
+        o->internal = flags & OF_INTERNAL;
+        tu->sc->vars.emplace(name, o);
+        tu->imported.push_back({name, o});
+    }
+
+    preprocessor& pp = tokens.preprocessing();
+    if (!read_macros(r, pp, path))
+        return false;
+    for (uint32_t n = r.u32(); n && r.ok; --n)
+        pp.mark_once(string(r.str()));
+    return r.ok && r.p == r.end;
+}
+
+translation_unit* read_pch(const string& path, token_stream& tokens,
+                           ostream& err)
+{
+    const char *begin, *end;
+    if (!map_file(path.c_str(), begin, end))
+    {
+        err << path << ": cannot read file\n";
+        return nullptr;
+    }
+
+    reader r{begin, end};
+    char head[sizeof magic];
+    r.take(head, sizeof head);
+    if (!r.ok || memcmp(head, magic, sizeof magic) != 0)
+    {
+        err << path << ": not a precompiled header\n";
+        return nullptr;
+    }
+    uint64_t stored = r.u64();
+    if (stored != xxHash64(StringRef(r.p, r.end - r.p)))
+    {
+        err << path << ": corrupt precompiled header\n";
+        return nullptr;
+    }
+
+    for (uint32_t n = r.u32(); n && r.ok; --n)
+    {
+        string file(r.str());
+        uint64_t sec = r.u64();
+        uint32_t nsec = r.u32();
+        uint64_t size = r.u64();
+        struct stat st;
+        if (r.ok && (stat(file.c_str(), &st) < 0
+                     || uint64_t(st.st_mtim.tv_sec) != sec
+                     || uint32_t(st.st_mtim.tv_nsec) != nsec
+                     || uint64_t(st.st_size) != size))
+        {
+            err << path << ": " << file << " has changed since the "
+                << "precompiled header was made\n";
+            return nullptr;
+        }
+    }
+
+    translation_unit* tu = make<translation_unit>();
+    tu->sc = make<scope>(true);
+    if (!r.ok || !read_body(r, tu, tokens, path))
+    {
+        err << path << ": corrupt precompiled header\n";
+        return nullptr;
+    }
+    return tu;
+}
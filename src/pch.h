@@ -0,0 +1,23 @@
+#pragma once
+#include <ostream>
+#include <string>
+#include "ast.h"
+using namespace std;
+
+// A precompiled header holds what parsing a header leaves behind: the
+// objects and struct tags of its file scope with their types, the macros it
+// defines and the headers it marks #pragma once. Reading one costs about as
+// much as mapping the file, however large the headers behind it. It is
+// refused once any file it was made from has changed.
+
+// Saves the file scope of tu, which may neither define functions nor
+// initialize variables, and the preprocessor state of tokens to path.
+// Returns false, with a message on err, if path cannot be written.
+bool write_pch(const string& path, translation_unit* tu, token_stream& tokens,
+               ostream& err);
+
+// A unit not parsed yet that starts with the declarations saved in path,
+// with tokens given its macros; nullptr, with a message on err, if path is
+// not a precompiled header or is out of date.
+translation_unit* read_pch(const string& path, token_stream& tokens,
+                           ostream& err);
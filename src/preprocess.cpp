@@ -0,0 +1,878 @@
+#include <cinttypes>
+#include <cstring>
+#include <unordered_map>
+#include <sys/stat.h>
+#include "constant.h"
+#include "error.h"
+#include "preprocess.h"
+using namespace std;
+
+
+vector<string> include_dirs;
+
+static const char* const system_include_dirs[] =
+{
+    "/usr/local/include", "/usr/include"
+};
+
+static const size_t max_include_depth = 200;
+static const size_t scratch_chunk = 4096;
+
+static const char predefined[] =
+    "#define __STDC__ 1\n"
+    "#define __STDC_HOSTED__ 1\n";
+
+// A header as read from disk, tokenized with offsets from its own start.
+struct header
+{
+    timespec mtime;
+    off_t size;
+    dev_t device;
+    ino_t inode;
+    const char* begin;
+    const char* end;
+    vector<token> tokens; // ends with END_OF_FILE
+    symbol guard;         // macro of an #ifndef around the whole file
+};
+
+// Symbols are per thread, and so are the tokens that hold them.
+static thread_local unordered_map<string, unique_ptr<header>> headers;
+
+enum directive_kind
+{
+    DIR_UNKNOWN,
+    DIR_IF, DIR_IFDEF, DIR_IFNDEF, DIR_ELIF, DIR_ELSE, DIR_ENDIF,
+    DIR_DEFINE, DIR_UNDEF, DIR_INCLUDE, DIR_PRAGMA, DIR_ERROR, DIR_LINE
+};
+
+static directive_kind classify(symbol name)
+{
+    static thread_local const unordered_map<symbol, directive_kind> kinds =
+    {
+        {intern("if"), DIR_IF}, {intern("ifdef"), DIR_IFDEF},
+        {intern("ifndef"), DIR_IFNDEF}, {intern("elif"), DIR_ELIF},
+        {intern("else"), DIR_ELSE}, {intern("endif"), DIR_ENDIF},
+        {intern("define"), DIR_DEFINE}, {intern("undef"), DIR_UNDEF},
+        {intern("include"), DIR_INCLUDE}, {intern("pragma"), DIR_PRAGMA},
+        {intern("error"), DIR_ERROR}, {intern("line"), DIR_LINE}
+    };
+    auto it = kinds.find(name);
+    return it == kinds.end() ? DIR_UNKNOWN : it->second;
+}
+
+// Kind of the directive starting at t[i], if one does.
+static directive_kind directive_at(const vector<token>& t, size_t i)
+{
+    if (t[i].kind != TK_HASH || !(t[i].flags & TF_LINE_START)
+        || t[i + 1].type == END_OF_FILE || t[i + 1].flags & TF_LINE_START)
+        return DIR_UNKNOWN;
+    return classify(t[i + 1].sym);
+}
+
+// The macro of an #ifndef group that spans the whole file, so that the file
+// has no effect while the macro is defined.
+static symbol include_guard(const vector<token>& t)
+{
+    size_t last = t.size() - 1;
+    if (last < 3 || directive_at(t, 0) != DIR_IFNDEF || !t[2].sym.id
+        || t[2].flags & TF_LINE_START
+        || !(t[3].flags & TF_LINE_START || t[3].type == END_OF_FILE))
+        return symbol();
+
+    int depth = 0;
+    for (size_t i = 0; i < last; ++i)
+    {
+        switch (directive_at(t, i))
+        {
+        case DIR_IF:
+        case DIR_IFDEF:
+        case DIR_IFNDEF:
+            ++depth;
+            break;
+        case DIR_ELIF:
+        case DIR_ELSE:
+            if (depth == 1)
+                return symbol();
+            break;
+        case DIR_ENDIF:
+            if (--depth == 0)
+            {
+                size_t j = i + 2;
+                while (j < last && !(t[j].flags & TF_LINE_START))
+                    ++j;
+                return j == last ? t[2].sym : symbol();
+            }
+            break;
+        default:
+            break;
+        }
+    }
+    return symbol();
+}
+
+// The header at path, tokenized on first use and again when the file
+// changes; nullptr if there is no readable file.
+static const header* load_header(const string& path)
+{
+    struct stat st;
+    if (stat(path.c_str(), &st) < 0 || !S_ISREG(st.st_mode))
+        return nullptr;
+
+    unique_ptr<header>& h = headers[path];
+    if (h && h->mtime.tv_sec == st.st_mtim.tv_sec
+        && h->mtime.tv_nsec == st.st_mtim.tv_nsec && h->size == st.st_size)
+        return h.get();
+
+    const char *begin, *end;
+    if (!map_file(path.c_str(), begin, end))
+        return nullptr;
+
+    auto fresh = make_unique<header>();
+    fresh->mtime = st.st_mtim;
+    fresh->size = st.st_size;
+    fresh->device = st.st_dev;
+    fresh->inode = st.st_ino;
+    fresh->begin = begin;
+    fresh->end = end;
+    lexer lex(begin, end, 0);
+    do
+        fresh->tokens.push_back(lex.next());
+    while (fresh->tokens.back().type != END_OF_FILE);
+    fresh->guard = include_guard(fresh->tokens);
+    h = move(fresh);
+    return h.get();
+}
+
+token preprocessor::file::get()
+{
+    if (has_peeked)
+    {
+        has_peeked = false;
+        return peeked;
+    }
+    if (lex)
+        return lex->next();
+    token tok = cached->tokens[pos];
+    if (pos + 1 < cached->tokens.size())
+        ++pos;
+    tok.offset += base;
+    return tok;
+}
+
+const token& preprocessor::file::peek()
+{
+    if (!has_peeked)
+    {
+        peeked = get();
+        has_peeked = true;
+    }
+    return peeked;
+}
+
+preprocessor::preprocessor(source_map& sources, const char* name,
+                           const char* begin, const char* end)
+    : sources(sources), defined(intern("defined")),
+      va_args(intern("__VA_ARGS__"))
+{
+    push_file(name, nullptr, begin, end);
+    push_file("<built-in>", nullptr, predefined,
+              predefined + sizeof predefined - 1);
+}
+
+preprocessor::~preprocessor() = default;
+
+void preprocessor::push_file(string path, const header* cached,
+                             const char* begin, const char* end)
+{
+    uint32_t base = sources.add(path, begin, end);
+    if (base == no_offset)
+        error::reject();
+
+    file& f = files.emplace_back();
+    f.path = move(path);
+    f.cached = cached;
+    f.base = base;
+    f.conditions = conditions.size();
+    if (!cached)
+        f.lex = make_unique<lexer>(begin, end, base);
+}
+
+bool preprocessor::skipping() const
+{
+    return !conditions.empty() && !conditions.back().active;
+}
+
+token preprocessor::next()
+{
+    for (;;)
+    {
+        token tok;
+        if (contexts.empty())
+            tok = read();
+        else
+        {
+            context& c = contexts.back();
+            if (c.pos == c.tokens.size())
+            {
+                bool barrier = c.barrier;
+                pop_context();
+                if (barrier)
+                    return token(END_OF_FILE);
+                continue;
+            }
+            tok = c.tokens[c.pos++];
+        }
+
+        if (!tok.sym.id || tok.flags & TF_NO_EXPAND)
+            return tok;
+        macro* m = find_macro(tok.sym);
+        if (!m)
+            return tok;
+        if (m->disabled)
+        {
+            tok.flags |= TF_NO_EXPAND;
+            return tok;
+        }
+        if (!expand(m, tok))
+            return tok;
+    }
+}
+
+// The next token of the files, with directives carried out and skipped
+// groups left out.
+token preprocessor::read()
+{
+    for (;;)
+    {
+        file& f = files.back();
+        token tok = f.get();
+        if (tok.type == END_OF_FILE)
+        {
+            if (conditions.size() > f.conditions)
+                error::reject(conditions.back().tok);
+            if (files.size() == 1)
+                return tok;
+            files.pop_back();
+            continue;
+        }
+
+        if (tok.kind == TK_HASH && tok.flags & TF_LINE_START)
+            directive();
+        else if (!skipping())
+            return tok;
+    }
+}
+
+token preprocessor::next_unexpanded()
+{
+    while (!contexts.empty())
+    {
+        context& c = contexts.back();
+        if (c.pos < c.tokens.size())
+            return c.tokens[c.pos++];
+        if (c.barrier)
+            return token(END_OF_FILE);
+        pop_context();
+    }
+    return read();
+}
+
+bool preprocessor::lparen_follows()
+{
+    for (size_t i = contexts.size(); i--; )
+    {
+        const context& c = contexts[i];
+        if (c.pos < c.tokens.size())
+            return c.tokens[c.pos].kind == TK_LPAREN;
+        if (c.barrier)
+            return false;
+    }
+    return files.back().peek().kind == TK_LPAREN;
+}
+
+void preprocessor::pop_context()
+{
+    if (macro* m = contexts.back().expanding)
+        m->disabled = false;
+    contexts.pop_back();
+}
+
+void preprocessor::set_macro(symbol name, unique_ptr<macro> m)
+{
+    if (name.id >= macros.size())
+        macros.resize(name.id + 1);
+    if (macros[name.id])
+        retired.push_back(move(macros[name.id]));
+    macros[name.id] = move(m);
+}
+
+void preprocessor::mark_once(const string& path)
+{
+    struct stat st;
+    if (stat(path.c_str(), &st) == 0
+        && once.insert({st.st_dev, st.st_ino}).second)
+        once_files.push_back(path);
+}
+
+// Replaces the macro name, and its arguments if it takes any, by the
+// expansion. Returns false if a function-like macro is not called.
+bool preprocessor::expand(macro* m, const token& name)
+{
+    vector<vector<token>> args;
+    if (m->function_like)
+    {
+        if (!lparen_follows())
+            return false;
+        next_unexpanded();
+
+        // commas inside parentheses or among the variable arguments do not
+        // separate arguments
+        args.emplace_back();
+        for (int depth = 0;;)
+        {
+            token tok = next_unexpanded();
+            if (tok.type == END_OF_FILE)
+                error::reject(name);
+            if (tok.kind == TK_RPAREN && !depth)
+                break;
+            if (tok.kind == TK_COMMA && !depth
+                && !(m->variadic && args.size() == m->params.size()))
+            {
+                args.emplace_back();
+                continue;
+            }
+            if (tok.kind == TK_LPAREN)
+                ++depth;
+            else if (tok.kind == TK_RPAREN)
+                --depth;
+            args.back().push_back(tok);
+        }
+
+        if (m->params.empty() && args.size() == 1 && args[0].empty())
+            args.clear();
+        if (m->variadic && args.size() + 1 == m->params.size())
+            args.emplace_back();
+        if (args.size() != m->params.size())
+            error::reject(name);
+    }
+
+    vector<token> tokens = substitute(*m, args);
+    m->disabled = true;
+    contexts.push_back({move(tokens), 0, m, false});
+    return true;
+}
+
+vector<token> preprocessor::expand_list(vector<token> tokens)
+{
+    contexts.push_back({move(tokens), 0, nullptr, true});
+    vector<token> out;
+    for (token tok; (tok = next()).type != END_OF_FILE; )
+        out.push_back(tok);
+    return out;
+}
+
+int preprocessor::parameter(const macro& m, const token& tok) const
+{
+    if (!m.function_like || !tok.sym.id)
+        return -1;
+    for (size_t i = 0; i < m.params.size(); ++i)
+        if (m.params[i] == tok.sym)
+            return i;
+    return -1;
+}
+
+// The body of m with the arguments put in: macro expanded, or as written
+// next to # and ##.
+vector<token> preprocessor::substitute(const macro& m,
+                                       const vector<vector<token>>& args)
+{
+    vector<token> out;
+    vector<vector<token>> expanded(args.size());
+    vector<bool> is_expanded(args.size());
+
+    // out.size() before the left operand of a ##; no tokens after it means
+    // the operand was an empty argument, and the right one is kept as is
+    size_t operand = 0;
+    const vector<token>& body = m.body;
+    for (size_t i = 0; i < body.size(); ++i)
+    {
+        const token& tok = body[i];
+        if (tok.kind == TK_HASH_HASH)
+        {
+            const token& rhs = body[++i];
+            int p = parameter(m, rhs);
+            vector<token> operand_tokens = p < 0 ? vector<token>{rhs} : args[p];
+            if (operand_tokens.empty())
+                continue;
+            if (out.size() > operand)
+            {
+                string text(out.back().str());
+                text += operand_tokens[0].str();
+                out.back() = make_token(text, tok);
+            }
+            else
+                out.push_back(operand_tokens[0]);
+            out.insert(out.end(), operand_tokens.begin() + 1, operand_tokens.end());
+            continue;
+        }
+
+        operand = out.size();
+        if (m.function_like && tok.kind == TK_HASH)
+        {
+            out.push_back(stringize(args[parameter(m, body[++i])], tok));
+            continue;
+        }
+
+        int p = parameter(m, tok);
+        if (p < 0)
+            out.push_back(tok);
+        else if (i + 1 < body.size() && body[i + 1].kind == TK_HASH_HASH)
+            out.insert(out.end(), args[p].begin(), args[p].end());
+        else
+        {
+            if (!is_expanded[p])
+                expanded[p] = expand_list(args[p]), is_expanded[p] = true;
+            out.insert(out.end(), expanded[p].begin(), expanded[p].end());
+        }
+    }
+    return out;
+}
+
+token preprocessor::stringize(const vector<token>& arg, const token& where)
+{
+    string text = "\"";
+    for (size_t i = 0; i < arg.size(); ++i)
+    {
+        if (i && arg[i].offset != arg[i - 1].offset + arg[i - 1].length)
+            text += ' ';
+        string_view s = arg[i].str();
+        bool literal = arg[i].type == STRING_LITERAL || s[0] == '\'';
+        for (char c : s)
+        {
+            if (literal && (c == '"' || c == '\\'))
+                text += '\\';
+            text += c;
+        }
+    }
+    text += '"';
+    return make_token(text, where);
+}
+
+// The single token spelled text, which must lex as exactly one.
+token preprocessor::make_token(const string& text, const token& where)
+{
+    if (text.size() > size_t(scratch_end - scratch_next))
+    {
+        size_t size = max(text.size(), scratch_chunk);
+        scratch.push_back(make_unique<char[]>(size));
+        scratch_next = scratch.back().get();
+        scratch_end = scratch_next + size;
+        scratch_base = sources.add("<scratch>", scratch_next, scratch_end);
+        if (scratch_base == no_offset)
+            error::reject(where);
+    }
+
+    const char* begin = scratch_next;
+    memcpy(scratch_next, text.data(), text.size());
+    scratch_next += text.size();
+
+    lexer lex(begin, scratch_next, scratch_base + (begin - scratch.back().get()));
+    token tok = lex.next();
+    if (tok.type == INVALID || tok.type == END_OF_FILE
+        || lex.next().type != END_OF_FILE)
+        error::reject(where);
+    tok.flags = 0;
+    return tok;
+}
+
+vector<token> preprocessor::rest_of_line()
+{
+    vector<token> line;
+    file& f = files.back();
+    while (f.peek().type != END_OF_FILE && !(f.peek().flags & TF_LINE_START))
+        line.push_back(f.get());
+    return line;
+}
+
+void preprocessor::directive()
+{
+    file& f = files.back();
+    const token& next = f.peek();
+    if (next.type == END_OF_FILE || next.flags & TF_LINE_START)
+        return; // the null directive
+    token name = f.get();
+    vector<token> line = rest_of_line();
+
+    directive_kind kind = classify(name.sym);
+    switch (kind)
+    {
+    case DIR_IF:
+    case DIR_IFDEF:
+    case DIR_IFNDEF:
+    {
+        if (skipping())
+        {
+            conditions.push_back({name, false, true, false});
+            return;
+        }
+        bool value;
+        if (kind == DIR_IF)
+            value = evaluate(move(line), name);
+        else
+        {
+            if (line.size() != 1 || !line[0].sym.id)
+                error::reject(line.empty() ? name : line.back());
+            value = (find_macro(line[0].sym) != nullptr) == (kind == DIR_IFDEF);
+        }
+        conditions.push_back({name, value, value, false});
+        return;
+    }
+
+    case DIR_ELIF:
+    case DIR_ELSE:
+    case DIR_ENDIF:
+    {
+        if (conditions.size() == f.conditions)
+            error::reject(name);
+        if (kind == DIR_ENDIF)
+        {
+            conditions.pop_back();
+            return;
+        }
+        condition& c = conditions.back();
+        if (c.seen_else)
+            error::reject(name);
+        if (kind == DIR_ELSE)
+        {
+            c.seen_else = true;
+            c.active = !c.taken;
+            c.taken = true;
+            return;
+        }
+        c.active = !c.taken && evaluate(move(line), name);
+        c.taken |= c.active;
+        return;
+    }
+
+    default:
+        break;
+    }
+
+    if (skipping())
+        return;
+
+    switch (kind)
+    {
+    case DIR_DEFINE:
+        define(line, name);
+        break;
+
+    case DIR_UNDEF:
+        if (line.size() != 1 || !line[0].sym.id)
+            error::reject(line.empty() ? name : line.back());
+        set_macro(line[0].sym, nullptr);
+        break;
+
+    case DIR_INCLUDE:
+        include(move(line), name);
+        break;
+
+    case DIR_PRAGMA:
+        if (line.size() == 1 && line[0].str() == "once")
+            mark_once(f.path);
+        break;
+
+    case DIR_LINE:
+        break;
+
+    default:
+        error::reject(name);
+    }
+}
+
+void preprocessor::define(const vector<token>& line, const token& where)
+{
+    if (line.empty() || !line[0].sym.id)
+        error::reject(line.empty() ? where : line[0]);
+    const token& name = line[0];
+
+    // function-like only with the ( right after the name
+    auto m = make_unique<macro>();
+    size_t i = 1;
+    if (i < line.size() && line[i].kind == TK_LPAREN
+        && line[i].offset == name.offset + name.length)
+    {
+        m->function_like = true;
+        ++i;
+        while (i == line.size() || line[i].kind != TK_RPAREN)
+        {
+            if (i == line.size() || m->variadic)
+                error::reject(i == line.size() ? line.back() : line[i]);
+            if (!m->params.empty())
+            {
+                if (line[i].kind != TK_COMMA)
+                    error::reject(line[i]);
+                if (++i == line.size())
+                    error::reject(line.back());
+            }
+
+            const token& param = line[i++];
+            if (param.kind == TK_ELLIPSIS)
+            {
+                m->params.push_back(va_args);
+                m->variadic = true;
+            }
+            else if (param.type == IDENTIFIER && parameter(*m, param) < 0)
+                m->params.push_back(param.sym);
+            else
+                error::reject(param);
+        }
+        ++i;
+    }
+
+    m->body.assign(line.begin() + i, line.end());
+    const vector<token>& body = m->body;
+    for (size_t j = 0; j < body.size(); ++j)
+    {
+        if (body[j].kind == TK_HASH_HASH && (j == 0 || j + 1 == body.size()))
+            error::reject(body[j]);
+        if (m->function_like && body[j].kind == TK_HASH
+            && (j + 1 == body.size() || parameter(*m, body[j + 1]) < 0))
+            error::reject(body[j]);
+    }
+    set_macro(name.sym, move(m));
+}
+
+void preprocessor::include(vector<token> line, const token& where)
+{
+    if (!line.empty() && line[0].type != STRING_LITERAL && line[0].kind != TK_LT)
+        line = expand_list(move(line));
+    if (line.empty())
+        error::reject(where);
+
+    string name;
+    size_t i = 1;
+    bool quoted = line[0].type == STRING_LITERAL;
+    if (quoted)
+    {
+        string_view s = line[0].str();
+        name = s.substr(1, s.size() - 2);
+    }
+    else if (line[0].kind == TK_LT)
+    {
+        for (; i < line.size() && line[i].kind != TK_GT; ++i)
+            name += line[i].str();
+        if (i++ == line.size())
+            error::reject(line.back());
+    }
+    else
+        error::reject(line[0]);
+    if (i != line.size())
+        error::reject(line[i]);
+    if (name.empty() || files.size() >= max_include_depth)
+        error::reject(line[0]);
+
+    vector<string> candidates;
+    if (name[0] == '/')
+        candidates.push_back(name);
+    else
+    {
+        if (quoted)
+        {
+            const string& path = files.back().path;
+            candidates.push_back(path.substr(0, path.rfind('/') + 1) + name);
+        }
+        for (const string& dir : include_dirs)
+            candidates.push_back(dir + '/' + name);
+        for (const char* dir : system_include_dirs)
+            candidates.push_back(string(dir) + '/' + name);
+    }
+
+    for (string& path : candidates)
+    {
+        const header* h = load_header(path);
+        if (!h)
+            continue;
+        if (once.count({h->device, h->inode})
+            || (h->guard.id && find_macro(h->guard)))
+            return;
+        push_file(move(path), h, h->begin, h->end);
+        return;
+    }
+    error::reject(line[0]);
+}
+
+// Precedence of the binary operators of #if, higher binding tighter; 0 for
+// other tokens.
+static int precedence(token_kind kind)
+{
+    switch (kind)
+    {
+    case TK_STAR: case TK_SLASH: case TK_PERCENT:
+        return 10;
+    case TK_PLUS: case TK_MINUS:
+        return 9;
+    case TK_SHL: case TK_SHR:
+        return 8;
+    case TK_LT: case TK_GT: case TK_LE: case TK_GE:
+        return 7;
+    case TK_EQ: case TK_NE:
+        return 6;
+    case TK_AMP:
+        return 5;
+    case TK_CARET:
+        return 4;
+    case TK_PIPE:
+        return 3;
+    case TK_AND_AND:
+        return 2;
+    case TK_OR_OR:
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+// Division by zero is an error only where the operands are evaluated.
+static intmax_t apply(const token& op, intmax_t a, intmax_t b, bool live)
+{
+    switch (op.kind)
+    {
+    case TK_STAR: return uintmax_t(a) * uintmax_t(b);
+    case TK_SLASH:
+    case TK_PERCENT:
+        if (!b || (a == INTMAX_MIN && b == -1))
+        {
+            if (live)
+                error::reject(op);
+            return 0;
+        }
+        return op.kind == TK_SLASH ? a / b : a % b;
+    case TK_PLUS: return uintmax_t(a) + uintmax_t(b);
+    case TK_MINUS: return uintmax_t(a) - uintmax_t(b);
+    case TK_SHL: return uintmax_t(a) << (b & 63);
+    case TK_SHR: return a >> (b & 63);
+    case TK_LT: return a < b;
+    case TK_GT: return a > b;
+    case TK_LE: return a <= b;
+    case TK_GE: return a >= b;
+    case TK_EQ: return a == b;
+    case TK_NE: return a != b;
+    case TK_AMP: return a & b;
+    case TK_CARET: return a ^ b;
+    case TK_PIPE: return a | b;
+    case TK_AND_AND: return a && b;
+    case TK_OR_OR: return a || b;
+    default: return 0;
+    }
+}
+
+// Macros in the condition are expanded, except for the operand of defined;
+// identifiers left over count as 0.
+bool preprocessor::evaluate(vector<token> line, const token& where)
+{
+    for (size_t i = 0; i < line.size(); ++i)
+    {
+        if (line[i].sym != defined)
+            continue;
+        line[i].flags |= TF_NO_EXPAND;
+        size_t j = i + 1;
+        if (j < line.size() && line[j].kind == TK_LPAREN)
+            ++j;
+        if (j < line.size())
+            line[j].flags |= TF_NO_EXPAND;
+    }
+
+    line = expand_list(move(line));
+    line.push_back(token(END_OF_FILE, where.offset));
+    size_t i = 0;
+    intmax_t value = evaluate_conditional(line, i, true);
+    if (line[i].type != END_OF_FILE)
+        error::reject(line[i]);
+    return value != 0;
+}
+
+intmax_t preprocessor::evaluate_conditional(const vector<token>& t, size_t& i,
+                                            bool live)
+{
+    intmax_t cond = evaluate_binary(t, i, 1, live);
+    if (t[i].kind != TK_QUESTION)
+        return cond;
+    ++i;
+    intmax_t a = evaluate_conditional(t, i, live && cond);
+    if (t[i].kind != TK_COLON)
+        error::reject(t[i]);
+    ++i;
+    intmax_t b = evaluate_conditional(t, i, live && !cond);
+    return cond ? a : b;
+}
+
+intmax_t preprocessor::evaluate_binary(const vector<token>& t, size_t& i,
+                                       int min_precedence, bool live)
+{
+    intmax_t lhs = evaluate_unary(t, i, live);
+    for (int prec; (prec = precedence(t[i].kind)) >= min_precedence; )
+    {
+        const token& op = t[i++];
+        bool rhs_live = live;
+        if (op.kind == TK_AND_AND)
+            rhs_live = live && lhs;
+        else if (op.kind == TK_OR_OR)
+            rhs_live = live && !lhs;
+        intmax_t rhs = evaluate_binary(t, i, prec + 1, rhs_live);
+        lhs = apply(op, lhs, rhs, live);
+    }
+    return lhs;
+}
+
+intmax_t preprocessor::evaluate_unary(const vector<token>& t, size_t& i,
+                                      bool live)
+{
+    const token& tok = t[i++];
+    switch (tok.kind)
+    {
+    case TK_PLUS:
+        return evaluate_unary(t, i, live);
+    case TK_MINUS:
+        return -uintmax_t(evaluate_unary(t, i, live));
+    case TK_TILDE:
+        return ~evaluate_unary(t, i, live);
+    case TK_NOT:
+        return !evaluate_unary(t, i, live);
+    case TK_LPAREN:
+    {
+        intmax_t value = evaluate_conditional(t, i, live);
+        if (t[i].kind != TK_RPAREN)
+            error::reject(t[i]);
+        ++i;
+        return value;
+    }
+    default:
+        break;
+    }
+
+    if (tok.sym == defined)
+    {
+        bool paren = t[i].kind == TK_LPAREN;
+        if (paren)
+            ++i;
+        const token& name = t[i++];
+        if (!name.sym.id)
+            error::reject(name);
+        if (paren && t[i++].kind != TK_RPAREN)
+            error::reject(t[i - 1]);
+        return find_macro(name.sym) != nullptr;
+    }
+    if (tok.sym.id)
+        return 0;
+    if (tok.type != CONSTANT)
+        error::reject(tok);
+
+    uint64_t value;
+    unsigned bits;
+    if (!integer_constant(tok.str(), value, bits))
+        error::reject(tok);
+    if (bits == 8)
+        return (signed char)value;
+    return value;
+}
@@ -0,0 +1,150 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+#include <sys/types.h>
+#include "tokenize.h"
+using namespace std;
+
+// Directories given with -I, searched in order by #include before the
+// system ones. A "..." name is first looked for next to the including file.
+extern vector<string> include_dirs;
+
+struct header;
+
+struct macro
+{
+    vector<token> body;
+    vector<symbol> params;
+    bool function_like = false;
+    bool variadic = false; // the last parameter is __VA_ARGS__
+    bool disabled = false; // being expanded, so its name stands for itself
+};
+
+// Runs the directives of a source file and expands its macros: #include,
+// #define and #undef of object-like and function-like macros with # and ##,
+// and #if, #ifdef, #ifndef, #elif, #else and #endif. Included headers are
+// kept tokenized per thread, keyed by path and modification time, and one
+// wrapped in an include guard or marked #pragma once is not read again.
+class preprocessor
+{
+public:
+    preprocessor(source_map& sources, const char* name, const char* begin,
+                 const char* end);
+    ~preprocessor();
+
+    // The next token for the parser. Past the end, returns END_OF_FILE
+    // every time.
+    token next();
+
+    // What a precompiled header keeps of the preprocessor: the macros now
+    // defined, by symbol id, and the files marked #pragma once, which are
+    // marked again with mark_once.
+    const vector<unique_ptr<macro>>& defined_macros() const
+    {
+        return macros;
+    }
+    const vector<string>& once_paths() const
+    {
+        return once_files;
+    }
+    void mark_once(const string& path);
+
+    // Restores a macro of a precompiled header, whose tokens lie in a
+    // buffer added with add_buffer.
+    void set_macro(symbol name, unique_ptr<macro> m);
+    uint32_t add_buffer(string name, const char* begin, const char* end)
+    {
+        return sources.add(move(name), begin, end);
+    }
+
+private:
+    // A file being read: the main file streamed from its lexer, a header
+    // replayed from its cached tokens, which are rebased to where the
+    // header lies in the source_map.
+    struct file
+    {
+        string path;
+        const header* cached = nullptr;
+        unique_ptr<lexer> lex;
+        size_t pos = 0;
+        uint32_t base = 0;
+        size_t conditions = 0; // groups already open when the file began
+
+        token get();
+        const token& peek();
+
+        bool has_peeked = false;
+        token peeked;
+    };
+
+    // Tokens of a macro expansion, rescanned before anything that follows
+    // them. A barrier context holds a list expanded on its own, such as a
+    // macro argument; nothing reads past its end.
+    struct context
+    {
+        vector<token> tokens;
+        size_t pos;
+        macro* expanding;
+        bool barrier;
+    };
+
+    // An open #if group with its #elif and #else branches.
+    struct condition
+    {
+        token tok;
+        bool active;    // tokens of the current branch are kept
+        bool taken;     // some branch has been or may not be chosen
+        bool seen_else;
+    };
+
+    token read();
+    token next_unexpanded();
+    bool lparen_follows();
+    void pop_context();
+    bool skipping() const;
+
+    bool expand(macro* m, const token& name);
+    vector<token> expand_list(vector<token> tokens);
+    vector<token> substitute(const macro& m, const vector<vector<token>>& args);
+    int parameter(const macro& m, const token& tok) const;
+    token stringize(const vector<token>& arg, const token& where);
+    token make_token(const string& text, const token& where);
+
+    // after the # that starts a line
+    void directive();
+    vector<token> rest_of_line();
+    void define(const vector<token>& line, const token& where);
+    void include(vector<token> line, const token& where);
+    void push_file(string path, const header* cached, const char* begin,
+                   const char* end);
+
+    bool evaluate(vector<token> line, const token& where);
+    intmax_t evaluate_conditional(const vector<token>& t, size_t& i, bool live);
+    intmax_t evaluate_binary(const vector<token>& t, size_t& i,
+                             int min_precedence, bool live);
+    intmax_t evaluate_unary(const vector<token>& t, size_t& i, bool live);
+
+    macro* find_macro(symbol name) const
+    {
+        return name.id < macros.size() ? macros[name.id].get() : nullptr;
+    }
+
+    source_map& sources;
+    vector<file> files;
+    vector<context> contexts;
+    vector<condition> conditions;
+    vector<unique_ptr<macro>> macros; // by symbol id
+    vector<unique_ptr<macro>> retired; // undefined while maybe expanding
+    set<pair<dev_t, ino_t>> once; // files marked #pragma once
+    vector<string> once_files;     // and the paths they were marked by
+    symbol defined, va_args;
+
+    // text made up by # and ##, in chunks registered with sources
+    vector<unique_ptr<char[]>> scratch;
+    char* scratch_next = nullptr;
+    char* scratch_end = nullptr;
+    uint32_t scratch_base = 0;
+};
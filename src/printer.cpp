@@ -23,7 +23,7 @@ struct printer
             buffer.pop_back();
     }
 
-    printer& operator << (const string& x)
+    printer& operator << (string_view x)
     {
         for (char c : x)
             buffer.push_back(c);
@@ -32,21 +32,22 @@ struct printer
 
     void flush(ostream& out)
     {
-        for (char c : buffer)
-            out << c;
-
+        out.write(buffer.data(), buffer.size());
         buffer = vector<char>();
     }
-} pout;
+};
+
+// one per thread, as units are printed concurrently
+static thread_local printer pout;
 
 void type_qualifier::print()
 {
-    pout << tok.str;
+    pout << tok.str();
 }
 
 void builtin_type_specifier::print()
 {
-    pout << tok.str;
+    pout << tok.str();
 }
 
 void struct_declaration::print()
@@ -76,9 +77,9 @@ void struct_declaration::print()
 
 void struct_or_union_specifier::print()
 {
-    pout << sou.str;
+    pout << sou.str();
     if (id.type != INVALID)
-        pout << " " << id.str;
+        pout << " " << id.str();
 
     if (has_sds)
     {
@@ -129,18 +130,18 @@ void declaration_specifiers::print()
 
 void storage_class_specifier::print()
 {
-    pout << tok.str;
+    pout << tok.str();
 }
 
 void function_specifier::print()
 {
-    pout << tok.str;
+    pout << tok.str();
 }
 
 void direct_declarator::print()
 {
     if (tok.type != INVALID)
-        pout << tok.str;
+        pout << tok.str();
 }
 
 void parenthesized_declarator::print()
@@ -204,6 +205,28 @@ void declarator::print()
 
     for (int i = 0; i < p.size(); ++i)
         pout << ")";
+
+    if (init)
+    {
+        pout << " = ";
+        init->print();
+    }
+}
+
+void initializer::print()
+{
+    if (expr)
+        return expr->print();
+    bool flg = false;
+    pout << "{";
+    for (initializer* in : list)
+    {
+        if (flg)
+            pout << ", ";
+        flg = true;
+        in->print();
+    }
+    pout << "}";
 }
 
 void declaration::print()
@@ -224,17 +247,7 @@ void declaration::print()
 
 void primary_expression::print()
 {
-    pout << tok.str;
-}
-
-void parenthesized_expression::print()
-{
-    expr->print();
-}
-
-void postfix_expression::print()
-{
-    pe->print();
+    pout << tok.str();
 }
 
 void subscript_expression::print()
@@ -253,7 +266,7 @@ void call_expression::print()
     pfe->print();
     pout << "(";
     bool flg = false;
-    for (assignment_expression* ae : args)
+    for (expression* ae : args)
     {
         if (flg)
             pout << ", ";
@@ -268,7 +281,7 @@ void dot_expression::print()
 {
     pout << "(";
     pfe->print();
-    pout << "." << id.str;
+    pout << "." << id.str();
     pout << ")";
 }
 
@@ -276,7 +289,7 @@ void arrow_expression::print()
 {
     pout << "(";
     pfe->print();
-    pout << "->" << id.str;
+    pout << "->" << id.str();
     pout << ")";
 }
 
@@ -297,71 +310,10 @@ void postfix_decrement_expression::print()
 }
 
 void unary_expression::print()
-{
-    pe->print();
-}
-
-void prefix_increment_expression::print()
-{
-    pout << "(";
-    pout << "++";
-    ue->print();
-    pout << ")";
-}
-
-void prefix_decrement_expression::print()
-{
-    pout << "(";
-    pout << "--";
-    ue->print();
-    pout << ")";
-}
-
-void unary_and_expression::print()
-{
-    pout << "(";
-    pout << "&";
-    ce->print();
-    pout << ")";
-}
-
-void unary_star_expression::print()
-{
-    pout << "(";
-    pout << "*";
-    ce->print();
-    pout << ")";
-}
-
-void unary_plus_expression::print()
-{
-    pout << "(";
-    pout << "+";
-    ce->print();
-    pout << ")";
-}
-
-void unary_minus_expression::print()
 {
     pout << "(";
-    pout << "-";
-    ce->print();
-    pout << ")";
-}
-
-void unary_tilde_expression::print()
-{
-    pout << "(";
-    pout << "~";
-    ce->print();
-    pout << ")";
-}
-
-void unary_not_expression::print()
-{
-    pout << "(";
-    pout << "!";
-    ce->print();
+    pout << op.str();
+    operand->print();
     pout << ")";
 }
 
@@ -383,287 +335,62 @@ void sizeof_type_expression::print()
 }
 
 void cast_expression::print()
-{
-    if (ue)
-        ue->print();
-
-    if (tn)
-    {
-        pout << "(";
-        pout << "(";
-        tn->print();
-        pout << ")";
-        ce->print();
-        pout << ")";
-    }
-}
-
-void multiplicative_expression::print()
-{
-    ce->print();
-}
-
-void mul_expression::print()
-{
-    pout << "(";
-    lhs->print();
-    pout << " * ";
-    rhs->print();
-    pout << ")";
-}
-
-void div_expression::print()
-{
-    pout << "(";
-    lhs->print();
-    pout << " / ";
-    rhs->print();
-    pout << ")";
-}
-
-void mod_expression::print()
-{
-    pout << "(";
-    lhs->print();
-    pout << " % ";
-    rhs->print();
-    pout << ")";
-}
-
-void additive_expression::print()
-{
-    me->print();
-}
-
-void add_expression::print()
-{
-    pout << "(";
-    lhs->print();
-    pout << " + ";
-    rhs->print();
-    pout << ")";
-}
-
-void sub_expression::print()
-{
-    pout << "(";
-    lhs->print();
-    pout << " - ";
-    rhs->print();
-    pout << ")";
-}
-
-void shift_expression::print()
-{
-    ae->print();
-}
-
-void rshift_expression::print()
-{
-    pout << "(";
-    lhs->print();
-    pout << " >> ";
-    rhs->print();
-    pout << ")";
-}
-
-void lshift_expression::print()
 {
     pout << "(";
-    lhs->print();
-    pout << " << ";
-    rhs->print();
-    pout << ")";
-}
-
-void relational_expression::print()
-{
-    se->print();
-}
-
-void less_expression::print()
-{
     pout << "(";
-    lhs->print();
-    pout << " < ";
-    rhs->print();
-    pout << ")";
-}
-
-void greater_expression::print()
-{
-    pout << "(";
-    lhs->print();
-    pout << " > ";
-    rhs->print();
+    tn->print();
     pout << ")";
-}
-
-void less_equal_expression::print()
-{
-    pout << "(";
-    lhs->print();
-    pout << " <= ";
-    rhs->print();
+    ce->print();
     pout << ")";
 }
 
-void greater_equal_expression::print()
+void binary_expression::print()
 {
     pout << "(";
     lhs->print();
-    pout << " >= ";
+    pout << " " << op.str() << " ";
     rhs->print();
     pout << ")";
 }
 
-void equality_expression::print()
-{
-    re->print();
-}
-
-void equal_expression::print()
+void conditional_expression::print()
 {
     pout << "(";
-    lhs->print();
-    pout << " == ";
-    rhs->print();
+    expr1->print();
+    pout << " ? ";
+    expr2->print();
+    pout << " : ";
+    expr3->print();
     pout << ")";
 }
 
-void not_equal_expression::print()
+void assignment_expression::print()
 {
     pout << "(";
     lhs->print();
-    pout << " != ";
+    pout << " " << op.str() << " ";
     rhs->print();
     pout << ")";
 }
 
-void and_expression::print()
-{
-    if (ee)
-        ee->print();
-    else
-    {
-        lhs->print();
-        pout << " & ";
-        rhs->print();
-    }
-}
-
-void exclusive_or_expression::print()
-{
-    if (ae)
-        ae->print();
-    else
-    {
-        pout << "(";
-        lhs->print();
-        pout << " ^ ";
-        rhs->print();
-        pout << ")";
-    }
-}
-
-void inclusive_or_expression::print()
-{
-    if (xe)
-        xe->print();
-    else
-    {
-        pout << "(";
-        lhs->print();
-        pout << " | ";
-        rhs->print();
-        pout << ")";
-    }
-}
-
-void logical_and_expression::print()
-{
-    if (oe)
-        oe->print();
-    else
-    {
-        pout << "(";
-        lhs->print();
-        pout << " && ";
-        rhs->print();
-        pout << ")";
-    }
-}
-
-void logical_or_expression::print()
-{
-    if (ae)
-        ae->print();
-    else
-    {
-        pout << "(";
-        lhs->print();
-        pout << " || ";
-        rhs->print();
-        pout << ")";
-    }
-}
-
-void conditional_expression::print()
-{
-    if (oe)
-        oe->print();
-    else
-    {
-        pout << "(";
-        expr1->print();
-        pout << " ? ";
-        expr2->print();
-        pout << " : ";
-        expr3->print();
-        pout << ")";
-    }
-}
-
-void assignment_expression::print()
-{
-    if (rhs)
-        pout << "(";
-
-    lhs->print();
-    if (rhs)
-    {
-        pout << " " << op.str << " ";
-        rhs->print();
-        pout << ")";
-    }
-}
-
-void constant_expression::print()
-{
-    ce->print();
-}
-
-void expression::print()
+void comma_expression::print()
 {
     bool flg = false;
-    if (ae.size() > 1)
-        pout << "(";
-
-    for (assignment_expression* ae : ae)
+    pout << "(";
+    for (expression* e : exprs)
     {
         if (flg)
             pout << ", ";
         flg = true;
-        ae->print();
+        e->print();
     }
-    if (ae.size() > 1)
-        pout << ")";
+    pout << ")";
 }
 
 void goto_label::print()
 {
     pout.unindent();
-    pout << id.str << ":\n";
+    pout << id.str() << ":\n";
     pout.indent();
     stat->print();
 }
@@ -780,7 +507,7 @@ void for_statement::print()
 
 void goto_statement::print()
 {
-    pout << "goto " << id.str << ";";
+    pout << "goto " << id.str() << ";";
 }
 
 void continue_statement::print()
@@ -846,7 +573,7 @@ void external_declaration::print()
         decl->print();
 }
 
-void translation_unit::print()
+void translation_unit::print(ostream& out)
 {
     bool flg = false;
     for (external_declaration* ed : ed)
@@ -857,4 +584,5 @@ void translation_unit::print()
         ed->print();
         pout << "\n";
     }
+    pout.flush(out);
 }
@@ -0,0 +1,122 @@
+#include "ssa.h"
+#include "ast.h"
+#include "llvm/IR/CFG.h"
+
+void ssa_builder::write(variable_object* v, BasicBlock* block, Value* val)
+{
+    defs[{block, v}] = val;
+}
+
+Value* ssa_builder::read(variable_object* v, BasicBlock* block)
+{
+    auto it = defs.find({block, v});
+    if (it != defs.end())
+        return it->second;
+    return read_recursive(v, block);
+}
+
+PHINode* ssa_builder::new_phi(variable_object* v, BasicBlock* block)
+{
+    PHINode* phi = PHINode::Create(v->type, 0);
+    block->getInstList().push_front(phi);
+    return phi;
+}
+
+// Sealed and without predecessors: code after a jump. What flows from it
+// into a phi does not matter.
+bool ssa_builder::is_dead(BasicBlock* block) const
+{
+    return sealed.count(block) && pred_empty(block)
+        && block != &block->getParent()->getEntryBlock();
+}
+
+Value* ssa_builder::read_recursive(variable_object* v, BasicBlock* block)
+{
+    Value* val;
+    if (!sealed.count(block))
+    {
+        PHINode* phi = new_phi(v, block);
+        incomplete[block].emplace_back(v, phi);
+        val = phi;
+    }
+    else if (BasicBlock* pred = block->getUniquePredecessor();
+             pred && visiting.insert(block).second)
+    {
+        // a block seen again closes a cycle nothing reaches; it gets a phi
+        val = read(v, pred);
+        visiting.erase(block);
+    }
+    else if (pred_empty(block))
+        val = UndefValue::get(v->type); // read before any write
+    else
+    {
+        // the phi breaks cycles through loops
+        PHINode* phi = new_phi(v, block);
+        write(v, block, phi);
+        val = add_operands(v, phi);
+    }
+    write(v, block, val);
+    return val;
+}
+
+Value* ssa_builder::add_operands(variable_object* v, PHINode* phi)
+{
+    BasicBlock* block = phi->getParent();
+    for (BasicBlock* pred : predecessors(block))
+        phi->addIncoming(read(v, pred), pred);
+    return remove_trivial(phi);
+}
+
+// A phi merging one value, besides itself and whatever comes from dead
+// blocks, is replaced by that value, which may make phis using it trivial in
+// turn.
+Value* ssa_builder::remove_trivial(PHINode* phi)
+{
+    Value* same = nullptr;
+    for (unsigned i = 0; i < phi->getNumIncomingValues(); ++i)
+    {
+        Value* op = phi->getIncomingValue(i);
+        if (op == same || op == phi || is_dead(phi->getIncomingBlock(i)))
+            continue;
+        if (same)
+            return phi;
+        same = op;
+    }
+    if (!same)
+        same = UndefValue::get(phi->getType());
+
+    vector<WeakVH> users;
+    for (User* u : phi->users())
+        if (u != phi && isa<PHINode>(u))
+            users.emplace_back(u);
+
+    phi->replaceAllUsesWith(same);
+    phi->eraseFromParent();
+
+    // same may itself be one of the phis removed now
+    WeakTrackingVH result = same;
+    for (WeakVH& u : users)
+        if (PHINode* p = dyn_cast_or_null<PHINode>(u))
+            remove_trivial(p);
+    return result;
+}
+
+void ssa_builder::seal(BasicBlock* block)
+{
+    auto it = incomplete.find(block);
+    if (it != incomplete.end())
+    {
+        vector<pair<variable_object*, PHINode*>> phis = move(it->second);
+        incomplete.erase(it);
+        for (auto& [v, phi] : phis)
+            add_operands(v, phi);
+    }
+    sealed.insert(block);
+}
+
+void ssa_builder::finish(Function* function)
+{
+    for (BasicBlock& block : *function)
+        if (!sealed.count(&block))
+            seal(&block);
+}
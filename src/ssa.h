@@ -0,0 +1,41 @@
+#pragma once
+#include <utility>
+#include <vector>
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/ValueHandle.h"
+using namespace std;
+using namespace llvm;
+
+struct variable_object;
+
+// Builds SSA form for the locals of one function while codegen emits it, as
+// in Braun et al., "Simple and Efficient Construction of Static Single
+// Assignment Form": a write records the value a variable holds at the end of
+// a block, a read looks it up through the predecessors, placing a phi where
+// they may disagree. A block is sealed once all its predecessors exist; a
+// read in a block not sealed yet places a phi whose operands are added when
+// it is. Phis that turn out to merge a single value are removed again.
+class ssa_builder
+{
+public:
+    void write(variable_object* v, BasicBlock* block, Value* val);
+    Value* read(variable_object* v, BasicBlock* block);
+    void seal(BasicBlock* block);
+
+    // seals the blocks still open, such as the targets of gotos
+    void finish(Function* function);
+
+private:
+    PHINode* new_phi(variable_object* v, BasicBlock* block);
+    bool is_dead(BasicBlock* block) const;
+    Value* read_recursive(variable_object* v, BasicBlock* block);
+    Value* add_operands(variable_object* v, PHINode* phi);
+    Value* remove_trivial(PHINode* phi);
+
+    DenseMap<pair<BasicBlock*, variable_object*>, WeakTrackingVH> defs;
+    DenseMap<BasicBlock*, vector<pair<variable_object*, PHINode*>>> incomplete;
+    SmallPtrSet<BasicBlock*, 32> sealed;
+    SmallPtrSet<BasicBlock*, 8> visiting; // by reads through single predecessors
+};
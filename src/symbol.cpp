@@ -0,0 +1,26 @@
+#include <deque>
+#include <unordered_map>
+#include "symbol.h"
+using namespace std;
+
+// Spellings are copied once, on first sight, and indexed by symbol id; the
+// deque keeps them in place so that the string_view keys stay valid. Every
+// thread interns into its own table, so units compiled in parallel never
+// contend.
+static thread_local deque<string> names(1);
+static thread_local unordered_map<string_view, symbol> symbols;
+
+string_view symbol::str() const
+{
+    return names[id];
+}
+
+symbol intern(string_view name)
+{
+    auto it = symbols.find(name);
+    if (it != symbols.end())
+        return it->second;
+
+    symbol sym(names.size());
+    return symbols.emplace(names.emplace_back(name), sym).first->second;
+}
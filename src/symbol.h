@@ -0,0 +1,44 @@
+#pragma once
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+using namespace std;
+
+// An interned identifier or keyword. All occurrences of one spelling share a
+// single entry in the symbol table of the interning thread, so symbols
+// compare and hash by their index there.
+struct symbol
+{
+    symbol() = default;
+    explicit symbol(uint32_t id) : id(id)
+    {
+    }
+
+    string_view str() const;
+
+    bool operator==(symbol other) const
+    {
+        return id == other.id;
+    }
+
+    bool operator!=(symbol other) const
+    {
+        return id != other.id;
+    }
+
+    uint32_t id = 0; // 0 is no symbol, with an empty spelling
+};
+
+namespace std
+{
+    template <> struct hash<symbol>
+    {
+        size_t operator()(symbol s) const
+        {
+            return hash<uint32_t>()(s.id);
+        }
+    };
+}
+
+symbol intern(string_view name);
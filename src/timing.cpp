@@ -0,0 +1,245 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstddef>
+#include <cstdlib>
+#include <mutex>
+#include <new>
+#include <time.h>
+#include <sys/resource.h>
+#include "timing.h"
+
+bool time_report = false;
+
+// Counts every allocation made through any form of operator new on this
+// thread: plain, array, nothrow and over-aligned. Plain integer, so it is
+// usable before and after the thread's other state.
+static thread_local size_t allocations;
+
+static void* allocate(size_t size, size_t align)
+{
+    ++allocations;
+    size = size ? size : 1;
+    if (align <= alignof(max_align_t))
+        return malloc(size);
+    void* p;
+    return posix_memalign(&p, align, size) == 0 ? p : nullptr;
+}
+
+static void* allocate_or_throw(size_t size, size_t align)
+{
+    if (void* p = allocate(size, align))
+        return p;
+    throw bad_alloc();
+}
+
+void* operator new(size_t size)
+{
+    return allocate_or_throw(size, 0);
+}
+
+void* operator new[](size_t size)
+{
+    return allocate_or_throw(size, 0);
+}
+
+void* operator new(size_t size, align_val_t align)
+{
+    return allocate_or_throw(size, size_t(align));
+}
+
+void* operator new[](size_t size, align_val_t align)
+{
+    return allocate_or_throw(size, size_t(align));
+}
+
+void* operator new(size_t size, const nothrow_t&) noexcept
+{
+    return allocate(size, 0);
+}
+
+void* operator new[](size_t size, const nothrow_t&) noexcept
+{
+    return allocate(size, 0);
+}
+
+void* operator new(size_t size, align_val_t align, const nothrow_t&) noexcept
+{
+    return allocate(size, size_t(align));
+}
+
+void* operator new[](size_t size, align_val_t align, const nothrow_t&) noexcept
+{
+    return allocate(size, size_t(align));
+}
+
+// every form of delete frees what one of the above returned
+void operator delete(void* p) noexcept { free(p); }
+void operator delete[](void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+void operator delete[](void* p, size_t) noexcept { free(p); }
+void operator delete(void* p, align_val_t) noexcept { free(p); }
+void operator delete[](void* p, align_val_t) noexcept { free(p); }
+void operator delete(void* p, size_t, align_val_t) noexcept { free(p); }
+void operator delete[](void* p, size_t, align_val_t) noexcept { free(p); }
+void operator delete(void* p, const nothrow_t&) noexcept { free(p); }
+void operator delete[](void* p, const nothrow_t&) noexcept { free(p); }
+void operator delete(void* p, align_val_t, const nothrow_t&) noexcept { free(p); }
+void operator delete[](void* p, align_val_t, const nothrow_t&) noexcept { free(p); }
+
+static const char* const phase_names[PHASE_COUNT] =
+{
+    "lex", "parse", "sema", "irgen", "opt", "emit"
+};
+
+struct phase_stats
+{
+    double wall = 0;
+    double cpu = 0;
+    size_t allocations = 0;
+    long peak_rss = 0;
+};
+
+struct snapshot
+{
+    chrono::steady_clock::time_point wall;
+    double cpu;
+    size_t allocations;
+};
+
+static thread_local phase_stats stats[PHASE_COUNT];
+static thread_local int current = -1;
+static thread_local snapshot last;
+
+static phase_stats totals[PHASE_COUNT];
+static mutex totals_lock;
+
+// Wall time belongs to the process: the clock of a phase runs while any
+// thread is in it, so threads that work on it together, or wait for the
+// ones that do, are counted once.
+static int busy[PHASE_COUNT];
+static chrono::steady_clock::time_point busy_since[PHASE_COUNT];
+
+static snapshot now()
+{
+    timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return {chrono::steady_clock::now(), ts.tv_sec + ts.tv_nsec * 1e-9,
+            allocations};
+}
+
+static long peak_rss()
+{
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+// Charges the CPU time and allocations since the last switch to the running
+// phase, then moves this thread over to phase to.
+static void switch_to(int to)
+{
+    snapshot s = now();
+    if (current >= 0)
+    {
+        phase_stats& st = stats[current];
+        st.cpu += s.cpu - last.cpu;
+        st.allocations += s.allocations - last.allocations;
+        st.peak_rss = max(st.peak_rss, peak_rss());
+    }
+    last = s;
+
+    lock_guard<mutex> lock(totals_lock);
+    if (current >= 0 && --busy[current] == 0)
+        totals[current].wall += chrono::duration<double>(s.wall - busy_since[current]).count();
+    if (to >= 0 && busy[to]++ == 0)
+        busy_since[to] = s.wall;
+    current = to;
+}
+
+phase_timer::phase_timer(phase p) : active(time_report), outer(-1)
+{
+    if (!active)
+        return;
+    outer = current;
+    switch_to(p);
+}
+
+phase_timer::~phase_timer()
+{
+    if (!active)
+        return;
+    switch_to(outer);
+}
+
+void collect_timings()
+{
+    lock_guard<mutex> lock(totals_lock);
+    for (int i = 0; i < PHASE_COUNT; ++i)
+    {
+        totals[i].cpu += stats[i].cpu;
+        totals[i].allocations += stats[i].allocations;
+        totals[i].peak_rss = max(totals[i].peak_rss, stats[i].peak_rss);
+        stats[i] = phase_stats();
+    }
+}
+
+static phase_stats sum()
+{
+    phase_stats all;
+    for (const phase_stats& st : totals)
+    {
+        all.wall += st.wall;
+        all.cpu += st.cpu;
+        all.allocations += st.allocations;
+    }
+    all.peak_rss = peak_rss();
+    return all;
+}
+
+void print_time_report(ostream& out, double total_wall)
+{
+    lock_guard<mutex> lock(totals_lock);
+    char line[128];
+    out << "===---------------------------------------------------------===\n"
+        << "                        c4 time report\n"
+        << "===---------------------------------------------------------===\n"
+        << "  phase        wall (s)     cpu (s)       allocs   peak rss (KiB)\n";
+    for (int i = 0; i < PHASE_COUNT; ++i)
+    {
+        const phase_stats& st = totals[i];
+        snprintf(line, sizeof line, "  %-8s %12.4f %11.4f %12zu %16ld\n",
+                 phase_names[i], st.wall, st.cpu, st.allocations, st.peak_rss);
+        out << line;
+    }
+    phase_stats all = sum();
+    snprintf(line, sizeof line, "  %-8s %12.4f %11.4f %12zu %16ld\n",
+             "total", total_wall, all.cpu, all.allocations, all.peak_rss);
+    out << line;
+}
+
+static void print_json(ostream& out, const char* name, const phase_stats& st)
+{
+    char line[192];
+    snprintf(line, sizeof line,
+             "{\"name\": \"%s\", \"wall_s\": %.6f, \"cpu_s\": %.6f, "
+             "\"allocations\": %zu, \"peak_rss_kib\": %ld}",
+             name, st.wall, st.cpu, st.allocations, st.peak_rss);
+    out << line;
+}
+
+void print_time_report_json(ostream& out, double total_wall)
+{
+    lock_guard<mutex> lock(totals_lock);
+    out << "{\"phases\": [";
+    for (int i = 0; i < PHASE_COUNT; ++i)
+    {
+        out << (i ? ",\n  " : "\n  ");
+        print_json(out, phase_names[i], totals[i]);
+    }
+    phase_stats all = sum();
+    all.wall = total_wall;
+    out << "],\n \"total\": ";
+    print_json(out, "total", all);
+    out << "}\n";
+}
@@ -0,0 +1,54 @@
+#pragma once
+#include <ostream>
+using namespace std;
+
+enum phase
+{
+    PHASE_LEX,
+    PHASE_PARSE,
+    // binding declarations to objects, struct layout, type specifiers and
+    // gotos; looking up the names an expression uses and folding constants
+    // happen token by token and stay with parse
+    PHASE_SEMA,
+    PHASE_IRGEN,
+    PHASE_OPT,
+    PHASE_EMIT,
+    PHASE_COUNT
+};
+
+// Set by --time-report; when false, phase_timer does nothing.
+extern bool time_report;
+
+// Charges the time and allocations of its lifetime to one phase. Timers
+// nest: an inner phase pauses the outer one, so every moment is charged to
+// exactly one phase of the thread. CPU time and allocations are kept per
+// thread until collect_timings.
+struct phase_timer
+{
+    explicit phase_timer(phase p);
+    ~phase_timer();
+
+    phase_timer(const phase_timer&) = delete;
+    phase_timer& operator = (const phase_timer&) = delete;
+
+private:
+    bool active;
+    int outer;
+};
+
+// Adds the measurements of the calling thread to the process totals.
+void collect_timings();
+
+// Per phase wall seconds during which any thread was in the phase, CPU
+// seconds and allocations summed over threads, and peak RSS seen by the end
+// of the phase; as a table or as JSON. Phases of units compiled in parallel
+// overlap, so their wall times may add up to more than the total.
+//
+// Allocations are calls to operator new, in any form, made by c4 and LLVM
+// alike: AST containers, IR objects, LLVM's hash tables. Memory taken with
+// malloc directly is not counted, which leaves out the slabs of the arena
+// and of LLVM's BumpPtrAllocator and the growth of SmallVector. The counter
+// always runs, at the cost of one thread-local increment; only the report
+// needs --time-report.
+void print_time_report(ostream& out, double total_wall);
+void print_time_report_json(ostream& out, double total_wall);
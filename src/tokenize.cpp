@@ -1,7 +1,17 @@
-#include <fstream>
-#include <algorithm>
+#include <array>
 #include <cstring>
-#include <map>
+#include <memory>
+#include <mutex>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include "error.h"
+#include "preprocess.h"
+#include "timing.h"
 #include "tokenize.h"
 using namespace std;
 
@@ -22,69 +32,303 @@ ostream& operator<<(ostream& out, const token_type tokn)
     return out << stringify(tokn);
 }
 
-vector<string> punctuators =
+const vector<pair<string, token_kind>> punctuators =
 {
-    "[", "]", "(", ")", "{", "}", ".", "->", "++", "--", "&", "*", "+", "-",
-    "~", "!", "/", "%", "<<", ">>", "<", ">", "<=", ">=", "==", "!=", "^",
-    "|", "&&", "||", "?", ":", ";", "...", "=", "*=", "/=", "%=", "+=", "-=",
-    "<<=", ">>=", "&=", "^=", "|=", ",", "#", "##", "<:", ":>", "<%", "%>",
-    "%:", "%:%:"
+    {"[", TK_LBRACKET}, {"]", TK_RBRACKET}, {"(", TK_LPAREN}, {")", TK_RPAREN},
+    {"{", TK_LBRACE}, {"}", TK_RBRACE}, {".", TK_DOT}, {"->", TK_ARROW},
+    {"++", TK_INC}, {"--", TK_DEC}, {"&", TK_AMP}, {"*", TK_STAR},
+    {"+", TK_PLUS}, {"-", TK_MINUS}, {"~", TK_TILDE}, {"!", TK_NOT},
+    {"/", TK_SLASH}, {"%", TK_PERCENT}, {"<<", TK_SHL}, {">>", TK_SHR},
+    {"<", TK_LT}, {">", TK_GT}, {"<=", TK_LE}, {">=", TK_GE}, {"==", TK_EQ},
+    {"!=", TK_NE}, {"^", TK_CARET}, {"|", TK_PIPE}, {"&&", TK_AND_AND},
+    {"||", TK_OR_OR}, {"?", TK_QUESTION}, {":", TK_COLON},
+    {";", TK_SEMICOLON}, {"...", TK_ELLIPSIS}, {"=", TK_ASSIGN},
+    {"*=", TK_MUL_ASSIGN}, {"/=", TK_DIV_ASSIGN}, {"%=", TK_MOD_ASSIGN},
+    {"+=", TK_ADD_ASSIGN}, {"-=", TK_SUB_ASSIGN}, {"<<=", TK_SHL_ASSIGN},
+    {">>=", TK_SHR_ASSIGN}, {"&=", TK_AND_ASSIGN}, {"^=", TK_XOR_ASSIGN},
+    {"|=", TK_OR_ASSIGN}, {",", TK_COMMA}, {"#", TK_HASH},
+    {"##", TK_HASH_HASH},
+    // digraphs
+    {"<:", TK_LBRACKET}, {":>", TK_RBRACKET}, {"<%", TK_LBRACE},
+    {"%>", TK_RBRACE}, {"%:", TK_HASH}, {"%:%:", TK_HASH_HASH}
 };
 
-vector<string> keywords =
+const vector<pair<string, token_kind>> keywords =
 {
-    "auto", "break", "case", "char", "const", "continue", "default",
-    "double", "do",  "else", "enum", "extern", "float", "for", "goto", "if",
-    "inline", "int", "long", "register", "restrict", "return", "short",
-    "signed", "sizeof", "static", "struct", "switch", "typedef", "union",
-    "unsigned", "void", "volatile", "while", "_Alignas", "_Alignof",
-    "_Atomic", "_Bool", "_Complex", "_Generic", "_Imaginary",
-    "_Noreturn", "_Static_assert", "_Thread_local"
+    {"auto", KW_AUTO}, {"break", KW_BREAK}, {"case", KW_CASE},
+    {"char", KW_CHAR}, {"const", KW_CONST}, {"continue", KW_CONTINUE},
+    {"default", KW_DEFAULT}, {"double", KW_DOUBLE}, {"do", KW_DO},
+    {"else", KW_ELSE}, {"enum", KW_ENUM}, {"extern", KW_EXTERN},
+    {"float", KW_FLOAT}, {"for", KW_FOR}, {"goto", KW_GOTO}, {"if", KW_IF},
+    {"inline", KW_INLINE}, {"int", KW_INT}, {"long", KW_LONG},
+    {"register", KW_REGISTER}, {"restrict", KW_RESTRICT},
+    {"return", KW_RETURN}, {"short", KW_SHORT}, {"signed", KW_SIGNED},
+    {"sizeof", KW_SIZEOF}, {"static", KW_STATIC}, {"struct", KW_STRUCT},
+    {"switch", KW_SWITCH}, {"typedef", KW_TYPEDEF}, {"union", KW_UNION},
+    {"unsigned", KW_UNSIGNED}, {"void", KW_VOID}, {"volatile", KW_VOLATILE},
+    {"while", KW_WHILE}, {"_Alignas", KW_ALIGNAS}, {"_Alignof", KW_ALIGNOF},
+    {"_Atomic", KW_ATOMIC}, {"_Bool", KW_BOOL}, {"_Complex", KW_COMPLEX},
+    {"_Generic", KW_GENERIC}, {"_Imaginary", KW_IMAGINARY},
+    {"_Noreturn", KW_NORETURN}, {"_Static_assert", KW_STATIC_ASSERT},
+    {"_Thread_local", KW_THREAD_LOCAL}
 };
 
 string escapable_chars = "'abfnrtv\\\"?";
 string escaped_chars = "\'\a\b\f\n\r\t\v\\\"\?";
 
-size_t match_str(const string& s, char* p)
+// Every byte of the input is classified exactly once through this table; the
+// class decides which scanner handles the token starting at that byte.
+enum char_class : uint8_t
 {
-    size_t match = 0;
-    for (size_t j = 0; j < s.size() && *p && s[j] == *p; ++j, ++p)
-        ++match;
+    CC_OTHER = 0,
+    CC_END,
+    CC_NEWLINE,
+    CC_SPACE,
+    CC_DIGIT,
+    CC_IDENT,
+    CC_PUNCT,
+    CC_QUOTE,
+    CC_DQUOTE
+};
 
-    return match;
+static const array<uint8_t, 256> char_classes = []
+{
+    array<uint8_t, 256> cc{};
+    cc['\0'] = CC_END;
+    cc['\n'] = CC_NEWLINE;
+    for (char c : string(" \t\v\f\r"))
+        cc[c] = CC_SPACE;
+    for (int c = '0'; c <= '9'; ++c)
+        cc[c] = CC_DIGIT;
+    for (int c = 'a'; c <= 'z'; ++c)
+        cc[c] = cc[c - 'a' + 'A'] = CC_IDENT;
+    cc['_'] = CC_IDENT;
+    for (auto& [s, kind] : punctuators)
+        cc[s[0]] = CC_PUNCT;
+    cc['\''] = CC_QUOTE;
+    cc['"'] = CC_DQUOTE;
+    return cc;
+}();
+
+static bool is_ident_char(char c)
+{
+    uint8_t cc = char_classes[(unsigned char)c];
+    return cc == CC_IDENT || cc == CC_DIGIT;
 }
 
-int read_keyword(char* p)
+// Deterministic automaton recognizing a fixed set of words, built once as a
+// trie over 7-bit characters. State 0 is dead, state 1 is the start state;
+// accepting states carry the kind of their word, others TK_NONE.
+struct word_dfa
 {
-    for (const string& s : keywords)
-        if (match_str(s, p) == s.size())
-            return s.size();
+    word_dfa(const vector<pair<string, token_kind>>& words) : next(2), accepts(2, TK_NONE)
+    {
+        for (auto& [s, kind] : words)
+        {
+            uint16_t state = 1;
+            for (char c : s)
+            {
+                if (!next[state][c])
+                {
+                    next[state][c] = next.size();
+                    next.emplace_back();
+                    accepts.push_back(TK_NONE);
+                }
+                state = next[state][c];
+            }
+            accepts[state] = kind;
+        }
+    }
 
-    return 0;
+    uint16_t step(uint16_t state, char c) const
+    {
+        return (unsigned char)c < 128 ? next[state][c] : 0;
+    }
+
+    // Length of the longest word that is a prefix of [p, end); its kind is
+    // stored in kind.
+    int longest_match(const char* p, const char* end, token_kind& kind) const
+    {
+        int match = 0;
+        uint16_t state = 1;
+        for (int len = 1; p < end && (state = step(state, *p)); ++p, ++len)
+            if (accepts[state])
+                match = len, kind = accepts[state];
+        return match;
+    }
+
+    vector<array<uint16_t, 128>> next;
+    vector<token_kind> accepts;
+};
+
+static const word_dfa punctuator_dfa(punctuators);
+static const word_dfa keyword_dfa(keywords);
+
+// No keyword is longer than this; longer identifiers skip the automaton.
+static const size_t longest_keyword = 14;
+
+// The scanners below look at 16 bytes at a time with SSE2 where available
+// and finish the last few bytes of the buffer one by one. A mask has bit i
+// set when byte i of the block matched.
+#ifdef __SSE2__
+struct block
+{
+    explicit block(const char* p) : v(_mm_loadu_si128((const __m128i*)p))
+    {
+    }
+
+    unsigned eq(char c) const
+    {
+        return _mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8(c)));
+    }
+
+    // Bytes in [lo, hi]; both bounds below 128.
+    unsigned in(char lo, char hi) const
+    {
+        return _mm_movemask_epi8(_mm_and_si128(
+            _mm_cmpgt_epi8(v, _mm_set1_epi8(lo - 1)),
+            _mm_cmplt_epi8(v, _mm_set1_epi8(hi + 1))));
+    }
+
+    unsigned identifier_chars() const
+    {
+        __m128i lower = _mm_or_si128(v, _mm_set1_epi8(0x20));
+        unsigned letters = _mm_movemask_epi8(_mm_and_si128(
+            _mm_cmpgt_epi8(lower, _mm_set1_epi8('a' - 1)),
+            _mm_cmplt_epi8(lower, _mm_set1_epi8('z' + 1))));
+        return letters | in('0', '9') | eq('_');
+    }
+
+    __m128i v;
+};
+#endif
+
+// Skips blanks and newlines; newline is set if there was one.
+static const char* skip_whitespace(const char* p, const char* end, bool& newline)
+{
+#ifdef __SSE2__
+    // most runs are a single blank, not worth a block
+    if (end - p >= 2 && *p == ' ' && p[1] != ' ' && p[1] != '\n')
+        return p + 1;
+    while (end - p >= 16)
+    {
+        block b(p);
+        unsigned other = ~(b.eq(' ') | b.in('\t', '\r')) & 0xffff;
+        int n = other ? __builtin_ctz(other) : 16;
+        if (b.eq('\n') & ((1u << n) - 1))
+            newline = true;
+        p += n;
+        if (other)
+            return p;
+    }
+#endif
+    for (; p < end; ++p)
+    {
+        if (*p == '\n')
+            newline = true;
+        else if (char_classes[(unsigned char)*p] != CC_SPACE)
+            break;
+    }
+    return p;
+}
+
+static const char* skip_identifier(const char* p, const char* end)
+{
+#ifdef __SSE2__
+    while (end - p >= 16)
+    {
+        unsigned other = ~block(p).identifier_chars() & 0xffff;
+        if (other)
+            return p + __builtin_ctz(other);
+        p += 16;
+    }
+#endif
+    while (p < end && is_ident_char(*p))
+        ++p;
+    return p;
 }
 
-int read_punctuator(char* p)
+// First newline, NUL or lone carriage return: the end of a // comment.
+static const char* find_line_end(const char* p, const char* end)
 {
-    sort(begin(punctuators), end(punctuators), [](const string& x, const string& y)
+#ifdef __SSE2__
+    while (end - p >= 16)
+    {
+        block b(p);
+        unsigned stop = b.eq('\n') | b.eq('\r') | b.eq('\0');
+        if (!stop)
+        {
+            p += 16;
+            continue;
+        }
+        p += __builtin_ctz(stop);
+        if (*p != '\r' || p + 1 == end || p[1] != '\n')
+            return p;
+        ++p;
+    }
+#endif
+    while (p < end && *p && *p != '\n')
     {
-        return x.size() > y.size();
-    });
+        if (*p == '\r' && (p + 1 == end || p[1] != '\n'))
+            break;
+        p++;
+    }
+    return p;
+}
 
-    for (const string& s : punctuators)
-        if (match_str(s, p) == s.size())
-            return s.size();
+// First "*/" or NUL; with neither, a position less than two bytes from end.
+static const char* find_comment_end(const char* p, const char* end)
+{
+#ifdef __SSE2__
+    while (end - p >= 17)
+    {
+        block b(p), next(p + 1);
+        if (unsigned stop = (b.eq('*') & next.eq('/')) | b.eq('\0'))
+            return p + __builtin_ctz(stop);
+        p += 16;
+    }
+#endif
+    while (p + 1 < end && *p && !(p[0] == '*' && p[1] == '/'))
+        ++p;
+    return p;
+}
 
-    return 0;
+static bool is_octal(char c)
+{
+    return c >= '0' && c <= '7';
 }
 
-int read_string(char* p)
+// Length of the escape sequence after a backslash at p: a character from
+// escapable_chars, one to three octal digits, or x and hex digits. 0 if
+// there is none.
+static int escape_length(const char* p, const char* end)
 {
-    if (*p != '"')
+    if (p == end || !*p)
         return 0;
+    if (escapable_chars.find(*p) != string::npos)
+        return 1;
+    if (is_octal(*p))
+    {
+        int n = 1;
+        while (n < 3 && p + n < end && is_octal(p[n]))
+            ++n;
+        return n;
+    }
+    if (*p == 'x')
+    {
+        int n = 1;
+        while (p + n < end && isxdigit((unsigned char)p[n]))
+            ++n;
+        return n > 1 ? n : 0;
+    }
+    return 0;
+}
 
+int read_string(const char* p, const char* end)
+{
     ++p;
     int match = 1;
-    while (*p)
+    while (p < end && *p)
     {
         ++match;
         if (*p == '"')
@@ -92,10 +336,11 @@ int read_string(char* p)
 
         if (*p == '\\')
         {
-            
-            ++p;
-            if (find(escapable_chars.begin(), escapable_chars.end(), *p) == escapable_chars.end()) return 0;
-            ++match;
+            int n = escape_length(++p, end);
+            if (!n) return 0;
+            match += n;
+            p += n;
+            continue;
         }
 
         ++p;
@@ -104,182 +349,362 @@ int read_string(char* p)
     return 0;
 }
 
-int read_number(char* p)
-{
-    int match = 0;
-    while (isdigit(*p))
-    {
-        ++match;
-        ++p;
-    }
-
-    return match;
-}
-
-int read_char(char* p)
+int read_char(const char* p, const char* end)
 {
-    if (*p != '\'') return 0;
-
     int match = 1;
     ++p;
-    
-    if (*p == '\'')
+
+    if (p == end || *p == '\'')
         return 0;
     ++match;
-    
+
     if (*p == '\\')
     {
-        ++match;
+        int n = escape_length(p + 1, end);
+        if (!n) return 0;
+        match += n + 1;
+        p += n + 1;
+    }
+    else
+    {
+        if (!*p) return 0;
         ++p;
-        if (find(escapable_chars.begin(), escapable_chars.end(), *p) == escapable_chars.end()) return 0;
+        ++match;
     }
 
-    if(!*p) return 0;
-    
-    ++p;
-    ++match;
-    
-    if (*p == '\'')
+    if (p < end && *p == '\'')
         return match;
 
     return 0;
 }
 
-int read_identifier(char* p)
+token lexer::emit(token_type type, const char* start, int size)
 {
-    int match = 0;
-    if (!isalpha(*p) && *p != '_') return 0;
-    ++match;
-    ++p;
-    while (*p && (isalpha(*p) || isdigit(*p) || *p == '_'))
-    {
-        ++p;
-        ++match;
-    }
+    token tok(type, base + (start - begin), size);
+    if (line_start)
+        tok.flags = TF_LINE_START, line_start = false;
+    return tok;
+}
 
-    return match;
+token lexer::next()
+{
+    token tok = has_pending ? pending : scan();
+    has_pending = false;
+    if (tok.type != INVALID)
+        return tok;
+
+    // an unterminated comment starts a run of its own
+    while ((pending = scan()).type == INVALID && pending.length == 1
+           && pending.offset == tok.offset + tok.length)
+        ++tok.length;
+    has_pending = true;
+    return tok;
 }
 
-vector<token> tokenize(char* p)
+token lexer::scan()
 {
-    vector<token> tokens;
-    int row = 1, col = 1;
-    while (*p)
+    while (p < end)
     {
-        if (*p == '/' && *(p + 1) == '/')
+        const char* start = p;
+        switch (char_classes[(unsigned char)*p])
         {
-            p += 2;
-            while (*p && *p != '\n')
+        case CC_END:
+            p = end;
+            continue;
+
+        case CC_NEWLINE:
+        case CC_SPACE:
+            p = skip_whitespace(p, end, line_start);
+            continue;
+
+        case CC_DIGIT:
+            // a preprocessing number, such as 0x1fUL; the parser makes sense
+            // of it
+            while (++p < end)
             {
-                if (*p == '\r' && *(1 + p) != '\n')
-                    break;
-                p++;
+                if (is_ident_char(*p) || *p == '.')
+                    continue;
+                if ((*p == '+' || *p == '-') && strchr("eEpP", p[-1]))
+                    continue;
+                break;
             }
+            return emit(CONSTANT, start, p - start);
 
-            if (p) ++p;
-            row += 1;
-            col = 1;
-            continue;
+        case CC_IDENT:
+        {
+            p = skip_identifier(p + 1, end);
+            token_kind kind = TK_NONE;
+            if (size_t(p - start) <= longest_keyword)
+            {
+                uint16_t state = 1;
+                for (const char* q = start; q != p && state; ++q)
+                    state = keyword_dfa.step(state, *q);
+                kind = keyword_dfa.accepts[state];
+            }
+            token tok = emit(kind ? KEYWORD : IDENTIFIER, start, p - start);
+            tok.kind = kind;
+            tok.sym = intern(string_view(start, p - start));
+            return tok;
         }
 
-        if (*p == '/' && *(p + 1) == '*')
-        {
-            char* q = strstr(p + 2, "*/");
-            if (q != NULL)
+        case CC_PUNCT:
+            if (*p == '/' && p + 1 < end && p[1] == '/')
+            {
+                p = find_line_end(p + 2, end);
+                if (p < end && *p) ++p;
+                line_start = true;
+                continue;
+            }
+
+            if (*p == '/' && p + 1 < end && p[1] == '*')
             {
-                while (p != q + 2)
+                const char* q = find_comment_end(p + 2, end);
+                if (q + 1 < end && *q)
                 {
-                    if (*p == '\n' || (*p == '\r' && *(p + 1) != '\n'))
-                        row++, col = 1;
-                    else
-                        col++;
-                    ++p;
+                    if (memchr(p, '\n', q - p))
+                        line_start = true;
+                    p = q + 2;
+                    continue;
                 }
+                p += 2;
+                return emit(INVALID, start, 2);
             }
-            else
+
+            token_kind kind;
+            if (int punct = punctuator_dfa.longest_match(p, end, kind))
+            {
+                p += punct;
+                token tok = emit(PUNCTUATOR, start, punct);
+                tok.kind = kind;
+                return tok;
+            }
+            break;
+
+        case CC_QUOTE:
+            if (int chrt = read_char(p, end))
+            {
+                p += chrt;
+                return emit(CONSTANT, start, chrt);
+            }
+            break;
+
+        case CC_DQUOTE:
+            if (int strt = read_string(p, end))
+            {
+                p += strt;
+                return emit(STRING_LITERAL, start, strt);
+            }
+            break;
+
+        case CC_OTHER:
+            // a backslash before a newline joins the lines
+            if (*p == '\\' && p + 1 < end && p[1] == '\n')
             {
-                tokens.emplace_back(INVALID, p, 2, col, row);
                 p += 2;
+                continue;
             }
-            continue;
+            if (*p == '\\' && end - p > 2 && p[1] == '\r' && p[2] == '\n')
+            {
+                p += 3;
+                continue;
+            }
+            break;
         }
 
-        if (*p == '\n')
-        {
-            col = 1;
-            ++row;
-            ++p;
-            continue;
-        }
+        ++p;
+        return emit(INVALID, start, 1);
+    }
+    return token(END_OF_FILE, base + (end - begin));
+}
 
-        if (isspace(*p))
-        {
-            ++col;
-            ++p;
-            continue;
-        }
+// Sources of the innermost live token_stream on this thread, which the
+// offsets of tokens refer to.
+static thread_local source_map* current_sources = nullptr;
 
-        if (int numt = read_number(p))
-        {
-            tokens.emplace_back(CONSTANT, p, numt, col, row);
-            p += numt;
-            col += numt;
-            continue;
-        }
+string_view token::str() const
+{
+    return length ? current_sources->text(offset, length) : string_view();
+}
+
+uint32_t source_map::add(string name, const char* begin, const char* end)
+{
+    if (next + (end - begin) + 1 >= no_offset)
+        return no_offset;
+    uint32_t base = next;
+    buffers.push_back({move(name), begin, base, line_index(begin, end)});
+    next += (end - begin) + 1;
+    return base;
+}
+
+source_map::buffer& source_map::find(uint32_t offset)
+{
+    buffer* b = &buffers[last];
+    if (offset >= b->base && (last + 1 == buffers.size() || offset < buffers[last + 1].base))
+        return *b;
+    auto it = upper_bound(buffers.begin(), buffers.end(), offset,
+                          [](uint32_t off, const buffer& b) { return off < b.base; });
+    last = it - buffers.begin() - 1;
+    return buffers[last];
+}
+
+string_view source_map::text(uint32_t offset, uint32_t length)
+{
+    buffer& b = find(offset);
+    return string_view(b.begin + (offset - b.base), length);
+}
 
-        if (int punct = read_punctuator(p))
+source_position source_map::locate(uint32_t offset)
+{
+    if (offset == no_offset)
+        return {buffers[0].name, 0, 0};
+    buffer& b = find(offset);
+    source_position pos = b.lines.locate(offset - b.base);
+    pos.file = b.name;
+    return pos;
+}
+
+vector<string> source_map::files() const
+{
+    vector<string> names;
+    for (const buffer& b : buffers)
+        if (b.name[0] != '<'
+            && std::find(names.begin(), names.end(), b.name) == names.end())
+            names.push_back(b.name);
+    return names;
+}
+
+token_stream::token_stream(const char* name, const char* begin, const char* end)
+    : outer(current_sources)
+{
+    current_sources = &sources;
+    pp = make_unique<preprocessor>(sources, name, begin, end);
+}
+
+token_stream::~token_stream()
+{
+    current_sources = outer;
+}
+
+void token_stream::refill(size_t pos)
+{
+    if (finished)
+        return;
+    phase_timer timer(PHASE_LEX);
+
+    if (failure)
+        rethrow_exception(failure);
+
+    // Slots from pos - lookbehind on must survive. An error is held back
+    // until the tokens before it have been used.
+    size_t limit = pos + capacity - lookbehind;
+    while (produced < limit)
+    {
+        token tok;
+        try
         {
-            tokens.emplace_back(PUNCTUATOR, p, punct, col, row);
-            p += punct;
-            col += punct;
-            continue;
+            tok = pp->next();
         }
-
-        if (int ident = read_identifier(p))
+        catch (const error&)
         {
-            int keyt = read_keyword(p);
-            if (keyt == ident) tokens.emplace_back(KEYWORD, p, keyt, col, row);
-            else tokens.emplace_back(IDENTIFIER, p, ident, col, row);
-            p += ident;
-            col += ident;
-            continue;
+            if (produced <= pos)
+                throw;
+            failure = current_exception();
+            return;
         }
-
-        if (int chrt = read_char(p))
+        ring[produced++ % capacity] = tok;
+        if (tok.type == END_OF_FILE)
         {
-            tokens.emplace_back(CONSTANT, p, chrt, col, row);
-            p += chrt;
-            col += chrt;
-            continue;
+            finished = true;
+            break;
         }
+    }
+}
 
-        if (int strt = read_string(p))
+source_position line_index::locate(uint32_t offset)
+{
+    if (starts.empty())
+    {
+        starts.push_back(0);
+        const char* p = begin;
+#ifdef __SSE2__
+        while (end - p >= 17)
         {
-            tokens.emplace_back(STRING_LITERAL, p, strt, col, row);
-            p += strt;
-            col += strt;
-            continue;
+            block b(p);
+            unsigned newlines = b.eq('\n');
+            if (unsigned returns = b.eq('\r'))
+                newlines |= returns & ~(block(p + 1).eq('\n'));
+            for (; newlines; newlines &= newlines - 1)
+                starts.push_back(p - begin + __builtin_ctz(newlines) + 1);
+            p += 16;
         }
-
-        if (tokens.size() && tokens.back().type == INVALID) tokens.back().str += *p;
-        else tokens.emplace_back(INVALID, p, 1, col, row);
-        ++p;
+#endif
+        for (; p != end; ++p)
+            if (*p == '\n' || (*p == '\r' && (p + 1 == end || p[1] != '\n')))
+                starts.push_back(p - begin + 1);
     }
 
-    tokens.emplace_back(END_OF_FILE, col, row);
-    return tokens;
+    auto line = upper_bound(starts.begin(), starts.end(), offset) - 1;
+    return {string_view(), int(line - starts.begin()) + 1, int(offset - *line) + 1};
 }
 
-vector<token> tokenize_file(const char* name)
+// A source file mapped read-only into memory. Tokens hold views into it, so
+// the mapping is never released before the process exits.
+struct mapped_file
+{
+    mapped_file(const char* data, size_t size) : data(data), size(size)
+    {
+    }
+
+    ~mapped_file()
+    {
+        if (size)
+            munmap((void*)data, size);
+    }
+
+    const char* data;
+    size_t size;
+};
+
+static vector<unique_ptr<mapped_file>> mapped_files;
+static mutex mapped_files_lock;
+
+bool map_file(const char* name, const char*& begin, const char*& end)
 {
-    ifstream f(name);
-    if (!f)
-        return {};
+    int fd = open(name, O_RDONLY);
+    if (fd < 0)
+        return false;
 
-    f.seekg(0, ios::end);
-    int sz = f.tellg();
-    f.seekg(0, ios::beg);
-    string data(sz, 0);
-    f.read(&data[0], sz);
-    return tokenize(&data[0]);
+    struct stat st;
+    if (fstat(fd, &st) < 0)
+    {
+        close(fd);
+        return false;
+    }
+
+    const char* data = "";
+    size_t size = st.st_size;
+    if (size >= no_offset)
+    {
+        close(fd);
+        return false;
+    }
+    if (size)
+    {
+        void* addr = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (addr == MAP_FAILED)
+        {
+            close(fd);
+            return false;
+        }
+        data = (const char*)addr;
+    }
+    close(fd);
+
+    {
+        lock_guard<mutex> lock(mapped_files_lock);
+        mapped_files.push_back(make_unique<mapped_file>(data, size));
+    }
+    begin = data;
+    end = data + size;
+    return true;
 }
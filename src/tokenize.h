@@ -1,9 +1,17 @@
 #pragma once
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <memory>
 #include <vector>
 #include <string>
+#include <string_view>
+#include "symbol.h"
 using namespace std;
 
-enum token_type : int
+enum token_type : uint8_t
 {
     INVALID = 0,
 
@@ -16,22 +24,226 @@ enum token_type : int
     END_OF_FILE
 };
 
+// Which punctuator or keyword a token is, assigned by the lexer. Digraphs
+// get the kind of the token they stand for. Other tokens are TK_NONE.
+enum token_kind : uint8_t
+{
+    TK_NONE = 0,
+
+    TK_LBRACKET, TK_RBRACKET, TK_LPAREN, TK_RPAREN, TK_LBRACE, TK_RBRACE,
+    TK_DOT, TK_ARROW, TK_INC, TK_DEC, TK_AMP, TK_STAR, TK_PLUS, TK_MINUS,
+    TK_TILDE, TK_NOT, TK_SLASH, TK_PERCENT, TK_SHL, TK_SHR, TK_LT, TK_GT, TK_LE,
+    TK_GE, TK_EQ, TK_NE, TK_CARET, TK_PIPE, TK_AND_AND, TK_OR_OR, TK_QUESTION,
+    TK_COLON, TK_SEMICOLON, TK_ELLIPSIS, TK_ASSIGN, TK_MUL_ASSIGN,
+    TK_DIV_ASSIGN, TK_MOD_ASSIGN, TK_ADD_ASSIGN, TK_SUB_ASSIGN, TK_SHL_ASSIGN,
+    TK_SHR_ASSIGN, TK_AND_ASSIGN, TK_XOR_ASSIGN, TK_OR_ASSIGN, TK_COMMA,
+    TK_HASH, TK_HASH_HASH,
+
+    KW_AUTO, KW_BREAK, KW_CASE, KW_CHAR, KW_CONST, KW_CONTINUE, KW_DEFAULT,
+    KW_DOUBLE, KW_DO, KW_ELSE, KW_ENUM, KW_EXTERN, KW_FLOAT, KW_FOR, KW_GOTO,
+    KW_IF, KW_INLINE, KW_INT, KW_LONG, KW_REGISTER, KW_RESTRICT, KW_RETURN,
+    KW_SHORT, KW_SIGNED, KW_SIZEOF, KW_STATIC, KW_STRUCT, KW_SWITCH, KW_TYPEDEF,
+    KW_UNION, KW_UNSIGNED, KW_VOID, KW_VOLATILE, KW_WHILE, KW_ALIGNAS,
+    KW_ALIGNOF, KW_ATOMIC, KW_BOOL, KW_COMPLEX, KW_GENERIC, KW_IMAGINARY,
+    KW_NORETURN, KW_STATIC_ASSERT, KW_THREAD_LOCAL
+};
+
+// Marks a token that has no place in the source, such as the one a bare
+// error::reject() throws.
+static constexpr uint32_t no_offset = UINT32_MAX;
+
+// Bits of token::flags.
+enum token_flag : uint8_t
+{
+    TF_LINE_START = 1, // first token on its line, as a directive's # must be
+    TF_NO_EXPAND = 2   // names a macro that must not be expanded here
+};
+
+// A plain 16-byte record. The spelling is not copied: str() reads it back
+// from the source_map of the innermost token_stream alive on this thread,
+// which must be the one the token came from.
 struct token
 {
-    token(token_type type = INVALID, int col = 0, int row = 0) : type(type), col(col), row(row)
+    token(token_type type = INVALID, uint32_t offset = no_offset, uint32_t length = 0)
+        : type(type), offset(offset), length(length)
     {
     }
 
-    token(token_type type, char* p, int sz, int col, int row)
-        : type(type), str(p, sz), col(col), row(row)
+    string_view str() const;
+
+    token_type type;
+    token_kind kind = TK_NONE;
+    uint8_t flags = 0;
+    uint32_t offset; // into the source_map of the unit
+    uint32_t length;
+    symbol sym; // interned spelling of identifiers and keywords
+};
+
+static_assert(sizeof(token) == 16, "tokens are kept small for the ring buffer");
+
+// File, line and column of a place in the source, counted from 1.
+struct source_position
+{
+    string_view file;
+    int row, col;
+};
+
+// Start offsets of the lines of a source buffer, so that a token offset can
+// be turned into a line and column when a diagnostic or --tokenize needs
+// one. Lines end at a newline or at a carriage return not followed by one.
+// Built the first time a position is asked for.
+class line_index
+{
+public:
+    line_index(const char* begin, const char* end) : begin(begin), end(end)
     {
     }
 
-    token_type type;
-    string str;
-    int col, row;
+    source_position locate(uint32_t offset);
+
+private:
+    const char* begin;
+    const char* end;
+    vector<uint32_t> starts;
+};
+
+// Every buffer the tokens of one unit come from, laid end to end in a single
+// 32-bit offset space: the source file, the headers it includes and text
+// the preprocessor makes up. Each buffer is followed by one unused offset,
+// which its END_OF_FILE token takes.
+class source_map
+{
+public:
+    // Offset of the first byte of [begin, end), or no_offset if the space
+    // is full.
+    uint32_t add(string name, const char* begin, const char* end);
+
+    string_view text(uint32_t offset, uint32_t length);
+
+    // Where offset lies; no_offset is placed at 0:0 of the first buffer.
+    source_position locate(uint32_t offset);
+
+    // Names of the buffers read from files, each once. Made-up buffers are
+    // named in angle brackets.
+    vector<string> files() const;
+
+private:
+    struct buffer
+    {
+        string name;
+        const char* begin;
+        uint32_t base;
+        line_index lines;
+    };
+
+    buffer& find(uint32_t offset);
+
+    deque<buffer> buffers;
+    uint64_t next = 0;
+    size_t last = 0; // most recently found buffer
 };
 
-vector<token> tokenize_file(const char* name);
+// Splits one buffer into tokens, one at a time. Runs of characters that
+// start no token are merged into one INVALID token.
+class lexer
+{
+public:
+    lexer(const char* begin, const char* end, uint32_t base)
+        : begin(begin), p(begin), end(end), base(base)
+    {
+    }
+
+    // Past the end, returns END_OF_FILE every time.
+    token next();
+
+private:
+    token scan();
+    token emit(token_type type, const char* start, int size);
+
+    const char* begin;
+    const char* p;
+    const char* end;
+    uint32_t base;
+    bool line_start = true;
+    bool has_pending = false;
+    token pending;
+};
+
+// Maps the file read-only into [begin, end) until the process exits, so
+// tokens can refer into it. Returns false if the file cannot be read or is
+// too large for 32-bit token offsets.
+bool map_file(const char* name, const char*& begin, const char*& end);
+
+class preprocessor;
+
+// The preprocessed tokens of a source file, scanned on demand. Tokens are
+// produced in batches into a fixed ring buffer that also keeps the last few
+// consumed ones, so memory does not grow with the size of the file. Past
+// the end, every position holds the END_OF_FILE token.
+class token_stream
+{
+public:
+    token_stream(const char* name, const char* begin, const char* end);
+    ~token_stream();
+
+    token_stream(const token_stream&) = delete;
+    token_stream& operator = (const token_stream&) = delete;
+
+    // Token at absolute position pos, which may lie at most lookbehind
+    // positions before the furthest one requested so far.
+    const token& at(size_t pos)
+    {
+        if (pos >= produced)
+            refill(pos);
+        return ring[min(pos, produced - 1) % capacity];
+    }
+
+    source_position locate(uint32_t offset)
+    {
+        return sources.locate(offset);
+    }
+
+    vector<string> files() const
+    {
+        return sources.files();
+    }
+
+    // The preprocessor feeding the stream, whose state a precompiled header
+    // saves and restores.
+    preprocessor& preprocessing()
+    {
+        return *pp;
+    }
+
+    static constexpr size_t capacity = 256;
+    static constexpr size_t lookbehind = 2;
+
+private:
+    void refill(size_t pos);
+
+    array<token, capacity> ring;
+    size_t produced = 0;
+    source_map sources;
+    unique_ptr<preprocessor> pp;
+    exception_ptr failure;
+    source_map* outer; // sources of the enclosing stream on this thread
+    bool finished = false;
+};
+
+// Position in a token_stream, with the iterator operations the parser uses.
+struct token_cursor
+{
+    token_stream* stream;
+    size_t pos;
+
+    const token& operator*() const { return stream->at(pos); }
+    const token* operator->() const { return &stream->at(pos); }
+    const token& operator[](size_t ahead) const { return stream->at(pos + ahead); }
+
+    token_cursor& operator++() { ++pos; return *this; }
+    token_cursor& operator--() { --pos; return *this; }
+    token_cursor operator++(int) { return {stream, pos++}; }
+    token_cursor operator--(int) { return {stream, pos--}; }
+};
 ostream& operator<<(ostream& out, const token_type tokn);
 const string& stringify(token_type type);
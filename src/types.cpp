@@ -1,66 +1,72 @@
 #include "ast.h"
+#include "timing.h"
 
-extern LLVMContext context;
+// The table below outlives any one unit's LLVMContext, so it holds how to
+// build each type rather than the types themselves.
+using make_type = Type* (*)(LLVMContext&);
 
-vector<scope*> scopes;
-map<string, tag*> htags;
-int tag_counter;
+template <unsigned bits>
+static Type* int_type(LLVMContext& context)
+{
+    return Type::getIntNTy(context, bits);
+}
 
 Type* valid_type_specifier(vector<type_specifier*> tsps)
 {
-    static const vector<pair<vector<vector<string>>, Type*>> valid = {
-        {{{"void"}}, Type::getVoidTy(context)},
-        {{{"char"}}, Type::getInt8Ty(context)},
-        {{{"signed", "char"}}, Type::getInt8Ty(context)},
-        {{{"unsigned", "char"}}, Type::getInt8Ty(context)},
+    phase_timer timer(PHASE_SEMA);
+    static const vector<pair<vector<vector<string>>, make_type>> valid = {
+        {{{"void"}}, Type::getVoidTy},
+        {{{"char"}}, int_type<8>},
+        {{{"signed", "char"}}, int_type<8>},
+        {{{"unsigned", "char"}}, int_type<8>},
         {{{"short"},
           {"signed", "short"},
           {"short", "int"},
-          {"signed", "short", "int"}}, Type::getInt16Ty(context)},
+          {"signed", "short", "int"}}, int_type<16>},
         {{{"unsigned", "short"},
-          {"unsigned", "short", "int"}}, Type::getInt16Ty(context)},
+          {"unsigned", "short", "int"}}, int_type<16>},
         {{{"int"},
           {"signed"},
-          {"signed", "int"}}, Type::getInt32Ty(context)},
+          {"signed", "int"}}, int_type<32>},
         {{{"unsigned"},
-          {"unsigned", "int"}}, Type::getInt32Ty(context)},
+          {"unsigned", "int"}}, int_type<32>},
         {{{"long"},
           {"signed", "long"},
           {"long", "int"},
-          {"signed", "long", "int"}}, Type::getInt64Ty(context)},
+          {"signed", "long", "int"}}, int_type<64>},
         {{{"unsigned", "long"},
-          {"unsigned", "long", "int"}}, Type::getInt64Ty(context)},
+          {"unsigned", "long", "int"}}, int_type<64>},
         {{{"long", "long"},
           {"signed", "long", "long"},
           {"long", "long", "int"},
-          {"signed", "long", "long", "int"}}, Type::getInt64Ty(context)},
+          {"signed", "long", "long", "int"}}, int_type<64>},
         {{{"unsigned", "long", "long"},
-          {"unsigned", "long", "long", "int"}}, Type::getInt64Ty(context)},
-        {{{"float"}}, Type::getFloatTy(context)},
-        {{{"double"}}, Type::getDoubleTy(context)},
-        {{{"long", "double"}}, Type::getFP128Ty(context)},
-        {{{"_Bool"}}, Type::getInt1Ty(context)},
+          {"unsigned", "long", "long", "int"}}, int_type<64>},
+        {{{"float"}}, Type::getFloatTy},
+        {{{"double"}}, Type::getDoubleTy},
+        {{{"long", "double"}}, Type::getFP128Ty},
+        {{{"_Bool"}}, int_type<1>},
         {{{"float", "_Complex"}}, nullptr},
         {{{"double", "_Complex"}}, nullptr},
         {{{"long", "double", "_Cmplex"}}, nullptr}
     };
 
-    map<string, int> freqb;
+    map<string_view, int> freqb;
     for (type_specifier* ts : tsps)
     {
         builtin_type_specifier* bts = dynamic_cast<builtin_type_specifier*>(ts);
-        freqb[bts->tok.str]++;
+        freqb[bts->tok.str()]++;
     }
 
     for (auto& [tsv, type] : valid)
     {
         for (auto& ts : tsv)
         {
-            map<string, int> freqa;
+            map<string_view, int> freqa;
             for (const string& s : ts)
                 freqa[s]++;
             if (freqa == freqb)
-                return type;
+                return type ? type(cu->context) : nullptr;
         }
     }
     return nullptr;
@@ -68,9 +74,10 @@ Type* valid_type_specifier(vector<type_specifier*> tsps)
 
 void function_definition::resolve_gotos()
 {
+    phase_timer timer(PHASE_SEMA);
     for (goto_statement* gs : gotos)
     {
-        auto glp = labels.find(gs->id.str);
+        auto glp = labels.find(gs->id.sym);
         if (glp == labels.end())
             error::reject(gs->id);
 
@@ -78,9 +85,9 @@ void function_definition::resolve_gotos()
     }
 }
 
-object* find_var(const string& id)
+object* find_var(symbol id)
 {
-    for (auto i = scopes.rbegin(); i != scopes.rend(); ++i)
+    for (auto i = cu->scopes.rbegin(); i != cu->scopes.rend(); ++i)
     {
         scope* s = *i;
         auto it = s->vars.find(id);
@@ -90,34 +97,26 @@ object* find_var(const string& id)
     return nullptr;
 }
 
-variable_object* find_variable(const string& id)
-{
-    return dynamic_cast<variable_object*>(find_var(id));
-}
-
-function_object* find_function(const string& id)
+tag::tag() : is_complete(false), id(cu->tag_counter++)
 {
-    return dynamic_cast<function_object*>(find_var(id));
+    type = StructType::create(cu->context, to_string(id));
+    cu->struct_tags[type] = this;
 }
 
-tag::tag() : is_complete(false)
-{
-    type = StructType::create(context, h = to_string(tag_counter++));
-}
-
-void tag::complete(vector<struct_declaration*>& sds)
+void tag::complete(avector<struct_declaration*>& sds)
 {
+    phase_timer timer(PHASE_SEMA);
     vector<Type*> members;
     for (struct_declaration* sd : sds)
     {
         for (declarator* dec : sd->ds)
         {
             token tok = dec->get_identifier();
-            if (indices.find(tok.str) != indices.end())
+            if (indices.find(tok.sym) != indices.end())
                 error::reject(tok);
 
             int next = indices.size();
-            indices[tok.str] = next;
+            indices.emplace(tok.sym, next);
             members.push_back(dec->gen_type(sd->type));
         }
     }
@@ -125,9 +124,9 @@ void tag::complete(vector<struct_declaration*>& sds)
     is_complete = true;
 }
 
-tag* find_tag(const string& id)
+tag* find_tag(symbol id)
 {
-    for (auto i = scopes.rbegin(); i != scopes.rend(); ++i)
+    for (auto i = cu->scopes.rbegin(); i != cu->scopes.rend(); ++i)
     {
         scope* s = *i;
         auto it = s->tags.find(id);
@@ -139,20 +138,20 @@ tag* find_tag(const string& id)
 
 Type* register_type(struct_or_union_specifier* ss)
 {
-    auto& table = scopes.back()->tags;
+    phase_timer timer(PHASE_SEMA);
+    auto& table = cu->scopes.back()->tags;
     if (!ss->has_sds)
     {
-        if (tag* t = find_tag(ss->id.str))
+        if (tag* t = find_tag(ss->id.sym))
             return t->type;
 
-        tag *t = new tag;
-        table[ss->id.str] = t;
-        htags[t->h] = t;
+        tag *t = make<tag>();
+        table.emplace(ss->id.sym, t);
         return t->type;
     }
     else
     {
-        auto it = table.find(ss->id.str);
+        auto it = table.find(ss->id.sym);
         if (it != table.end())
         {
             tag *t = it->second;
@@ -165,11 +164,234 @@ Type* register_type(struct_or_union_specifier* ss)
         else
         {
             // definicija
-            tag *t = new tag;
+            tag *t = make<tag>();
             t->complete(ss->sds);
-            table[ss->id.str] = t;
-            htags[t->h] = t;
+            table.emplace(ss->id.sym, t);
             return t->type;
         }
     }
 }
+
+// The static types below follow what codegen builds for each operator: the
+// wider of two integers as adjust_int widens them, a pointer for a pointer
+// plus or minus an integer as create_add and create_sub give it.
+
+static Type* wider_int(Type* l, Type* r)
+{
+    if (!l || !r || !l->isIntegerTy() || !r->isIntegerTy())
+        return nullptr;
+    return l->getPrimitiveSizeInBits() >= r->getPrimitiveSizeInBits() ? l : r;
+}
+
+static Type* sum_type(Type* l, Type* r)
+{
+    if (!l || !r || l->isStructTy() || r->isStructTy())
+        return nullptr;
+    if (l->isPointerTy() && r->isPointerTy())
+        return nullptr;
+    if (r->isPointerTy())
+        return r;
+    if (l->isPointerTy())
+        return l;
+    return wider_int(l, r);
+}
+
+static Type* difference_type(Type* l, Type* r)
+{
+    if (!l || !r || l->isStructTy() || r->isStructTy())
+        return nullptr;
+    if (l->isPointerTy() && r->isPointerTy())
+    {
+        // the difference in bytes divided by the 64-bit size of the pointee
+        if (l->getContainedType(0) != r->getContainedType(0))
+            return nullptr;
+        return Type::getInt64Ty(cu->context);
+    }
+    if (r->isPointerTy())
+        return nullptr;
+    if (l->isPointerTy())
+        return l;
+    return wider_int(l, r);
+}
+
+static Type* pointee(Type* type)
+{
+    if (!type || !type->isPointerTy())
+        return nullptr;
+    return type->getContainedType(0);
+}
+
+// Type of the member id of a struct of type type; nullptr if it has none.
+static Type* member_type(Type* type, const token& id)
+{
+    if (!type || !type->isStructTy())
+        return nullptr;
+    auto it = cu->struct_tags.find((StructType*)type);
+    if (it == cu->struct_tags.end())
+        return nullptr;
+    auto index = it->second->indices.find(id.sym);
+    if (index == it->second->indices.end())
+        return nullptr;
+    return type->getStructElementType(index->second);
+}
+
+Type* primary_expression::static_type()
+{
+    if (tok.type == IDENTIFIER && var)
+    {
+        if (var->kind == OBJECT_VARIABLE)
+            return ((variable_object*)var)->type;
+        return PointerType::getUnqual(((function_object*)var)->type);
+    }
+    if (tok.type == CONSTANT && value)
+        return value->getType();
+    if (tok.type == STRING_LITERAL)
+        return Type::getInt8PtrTy(cu->context);
+    return nullptr;
+}
+
+Type* subscript_expression::static_type()
+{
+    return pointee(sum_type(pfe->static_type(), expr->static_type()));
+}
+
+Type* call_expression::static_type()
+{
+    Type* type = pointee(pfe->static_type());
+    if (!type || !type->isFunctionTy())
+        return nullptr;
+    return ((FunctionType*)type)->getReturnType();
+}
+
+Type* dot_expression::static_type()
+{
+    return member_type(pfe->static_type(), id);
+}
+
+Type* arrow_expression::static_type()
+{
+    return member_type(pointee(pfe->static_type()), id);
+}
+
+Type* postfix_increment_expression::static_type()
+{
+    return pfe->static_type();
+}
+
+Type* postfix_decrement_expression::static_type()
+{
+    return pfe->static_type();
+}
+
+Type* unary_expression::static_type()
+{
+    Type* type = operand->static_type();
+    if (!type)
+        return nullptr;
+    switch (kind)
+    {
+    case UNARY_ADDRESS:
+        return PointerType::getUnqual(type);
+    case UNARY_DEREFERENCE:
+        // a function designator stays a pointer to the function
+        if (!type->isPointerTy())
+            return nullptr;
+        return type->getContainedType(0)->isFunctionTy() ? type : type->getContainedType(0);
+    case UNARY_MINUS:
+        return type->isIntegerTy() ? type : nullptr;
+    case UNARY_NOT:
+        return Type::getInt1Ty(cu->context);
+    default:
+        return type;
+    }
+}
+
+Type* sizeof_expression::static_type()
+{
+    return Type::getInt64Ty(cu->context);
+}
+
+Type* sizeof_type_expression::static_type()
+{
+    return Type::getInt64Ty(cu->context);
+}
+
+Type* cast_expression::static_type()
+{
+    return tn->type;
+}
+
+Type* binary_expression::static_type()
+{
+    Type* l = lhs->static_type();
+    Type* r = rhs->static_type();
+    switch (kind)
+    {
+    case BINARY_ADD:
+        return sum_type(l, r);
+    case BINARY_SUB:
+        return difference_type(l, r);
+    case BINARY_SHL:
+    case BINARY_SHR:
+        return l;
+    case BINARY_LOGICAL_AND:
+    case BINARY_LOGICAL_OR:
+        return Type::getInt1Ty(cu->context);
+    case BINARY_LT:
+    case BINARY_GT:
+    case BINARY_LE:
+    case BINARY_GE:
+    case BINARY_EQ:
+    case BINARY_NE:
+        if (!l || !r || (l != r && !wider_int(l, r)))
+            return nullptr;
+        return Type::getInt1Ty(cu->context);
+    default:
+        return wider_int(l, r);
+    }
+}
+
+Type* conditional_expression::static_type()
+{
+    Type* t = expr2->static_type();
+    Type* f = expr3->static_type();
+    if (!t || !f)
+        return nullptr;
+    if (t == f)
+        return t;
+    if (t->isStructTy() || f->isStructTy())
+        return nullptr;
+    if (t->isPointerTy() && f->isPointerTy())
+        return nullptr;
+    if (t->isPointerTy())
+        return t;
+    if (f->isPointerTy())
+        return f;
+    return wider_int(t, f);
+}
+
+Type* assignment_expression::static_type()
+{
+    Type* l = lhs->static_type();
+    Type* r = rhs->static_type();
+    switch (op.kind)
+    {
+    case TK_ASSIGN:
+        return r;
+    case TK_MUL_ASSIGN:
+    case TK_DIV_ASSIGN:
+    case TK_MOD_ASSIGN:
+        return wider_int(l, r);
+    case TK_ADD_ASSIGN:
+        return sum_type(l, r);
+    case TK_SUB_ASSIGN:
+        return difference_type(l, r);
+    default:
+        return l;
+    }
+}
+
+Type* comma_expression::static_type()
+{
+    return exprs.back()->static_type();
+}
@@ -1,19 +1,53 @@
 #include <string>
+#include <string_view>
+#include "constant.h"
 using namespace std;
 
 extern string escapable_chars;
 extern string escaped_chars;
 
-string unescape(const string& s)
+static int digit_value(char c)
+{
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    return 16;
+}
+
+char unescape_char(const char*& p, const char* end)
+{
+    size_t idx = escapable_chars.find(*p);
+    if (idx != escapable_chars.npos)
+        return ++p, escaped_chars[idx];
+
+    // octal takes at most three digits, hex as many as there are; the
+    // character keeps the low byte
+    unsigned value = 0;
+    if (*p == 'x')
+    {
+        while (++p < end && digit_value(*p) < 16)
+            value = value * 16 + digit_value(*p);
+        return value;
+    }
+    for (int n = 0; n < 3 && p < end && *p >= '0' && *p <= '7'; ++n, ++p)
+        value = value * 8 + (*p - '0');
+    return value;
+}
+
+string unescape(string_view s)
 {
     string z;
-    for (int i = 1; i < s.size() - 1; ++i)
+    const char* p = s.data() + 1;
+    const char* end = s.data() + s.size() - 1;
+    while (p < end)
     {
-        size_t idx = escapable_chars.find(s[i + 1]);
-        if (s[i] == '\\' && idx != escapable_chars.npos)
-            z.push_back(escaped_chars[idx]), ++i;
+        if (*p == '\\')
+            z.push_back(unescape_char(++p, end));
         else
-            z.push_back(s[i]);
+            z.push_back(*p++);
     }
     return z;
 }
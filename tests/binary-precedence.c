@@ -0,0 +1,9 @@
+int printf(char*, ...);
+int main(void)
+{
+    int a; int b; int c;
+    a = 1; b = 2; c = 3;
+    printf("%d %d %d %d\n", 1 + 2 * 3 << 1 < 20 == 1 & 3 ^ 1 | 4 && 1 || 0, a == b == 0, 10 - 3 - 2, 100 / 5 / 2 % 7);
+    printf("%d %d\n", a < b < c, c - b * a + 8 >> 1 >> 1);
+    return 0;
+}
@@ -0,0 +1,39 @@
+int printf(char*, ...);
+
+#if 0x10 == 16 && '\n' == 10 && 010 == 8
+#define OK 1
+#else
+#define OK 0
+#endif
+
+int kind(long x)
+{
+    switch (x)
+    {
+    case 0x7fffffff:
+        return 1;
+    case 'a' + 1:
+        return 2;
+    case 1 && 2:
+        return 3;
+    case sizeof(int) ? 4 : 5:
+        return 4;
+    case (char)300:
+        return 5;
+    case (-1 >> 1) * 6:
+        return 6;
+    }
+    return 0;
+}
+
+int main(void)
+{
+    long big;
+    big = 0xffffffffL + 1;
+    printf("%d %d %d %d %d\n", 0x1F, 017, 42u, 'A', OK);
+    printf("%d %d %d %d\n", '\0', '\x41', '\101', '\\');
+    printf("%d %d %d\n", sizeof 1, sizeof 1L, sizeof big);
+    printf("%d %d %d %d %d %d\n", kind(2147483647), kind(98), kind(1), kind(4), kind(44), kind(-6));
+    printf("%d %s\n", (int)(big >> 32), "tab\there\x21\041");
+    return 0;
+}
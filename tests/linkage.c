@@ -0,0 +1,74 @@
+int printf(char*, ...);
+
+struct point
+{
+    int x;
+    int y;
+};
+
+struct line
+{
+    struct point from;
+    struct point to;
+    char* name;
+};
+
+extern int total;
+int total = 40;
+int tentative;
+int tentative;
+static int hidden = 'h';
+static int unused = 3;
+long big = 0x10000000000;
+char* greeting = "hello";
+int* where = &total;
+struct line diagonal = {{1, 2}, {3}, "diagonal"};
+struct point origin = {};
+
+static int twice(int x)
+{
+    return x * 2;
+}
+
+static int never_called(int x)
+{
+    return twice(x) + unused;
+}
+
+inline int square(int x)
+{
+    return x * x;
+}
+extern int square(int x);
+
+static inline int cube(int x)
+{
+    return x * square(x);
+}
+
+int (*op)(int) = twice;
+
+int count(void)
+{
+    static int calls;
+    static int step = 2;
+    calls = calls + step;
+    return calls;
+}
+
+int main(void)
+{
+    extern int tentative;
+    int a = 3, b = a + 4;
+    struct point p = {a, b};
+    struct point q = p;
+    char* s = greeting;
+    count();
+    count();
+    tentative = count();
+    printf("%d %d %d %d %d\n", total, tentative, hidden, a, b);
+    printf("%d %d %d %d\n", p.x + q.y, diagonal.from.y, diagonal.to.x, diagonal.to.y);
+    printf("%s %s %d %ld\n", s, diagonal.name, *where, big / 0x4000000000);
+    printf("%d %d %d %d\n", op(5), square(6), cube(2), origin.x + origin.y);
+    return 0;
+}
@@ -0,0 +1,43 @@
+#define STR(x) #x
+#define XSTR(x) STR(x)
+#define CAT(a, b) a ## b
+#define EMPTY
+#define TWICE(x) ((x) + (x))
+#define PRINT(fmt, ...) printf(fmt, __VA_ARGS__)
+#define SELF SELF
+#define f(a) a*g
+#define g(a) f(a)
+#define LIMIT 5
+
+int printf(char*, ...);
+
+#if defined(LIMIT) && LIMIT > 3 && !defined NOPE
+int chosen(void) { return 1; }
+#elif 1/0
+int chosen(void) { return 2; }
+#else
+int chosen(void) { return 3; }
+#endif
+
+#if 0
+#error skipped
+#else
+int pasted(void) { return CAT(1, 2) + CAT(, 3) + CAT(4, ); }
+#endif
+
+#undef LIMIT
+#ifndef LIMIT
+int undefined(void) { return (2 || 1/0) && -1 < 0 && 7 % 4 == 3 && 'a' == 97; }
+#endif
+
+int main(void)
+{
+    int SELF;
+    int g;
+    int CAT(my, var);
+    SELF = 0;
+    g = 1;
+    myvar = TWICE(__STDC__);
+    PRINT("%s %s %d %d %d\n", STR( a  "b\n" 'c' ), XSTR(__STDC__ EMPTY), chosen(), pasted(), undefined());
+    return f(2)(9) - 2*9 + myvar - 2 + SELF;
+}
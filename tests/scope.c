@@ -0,0 +1,27 @@
+int printf(char*, ...);
+
+int x;
+
+int main(void)
+{
+    int y;
+    x = 1;
+    y = x;
+    {
+        y = y + x;
+        int x;
+        x = 5;
+        y = y + x;
+        {
+            int g(void);
+            y = y + g();
+        }
+    }
+    printf("%d %d\n", x, y);
+    return 0;
+}
+
+int g(void)
+{
+    return 10;
+}
@@ -0,0 +1,44 @@
+int printf(char*, ...);
+
+struct s
+{
+    char c;
+    long m;
+};
+
+short half(void);
+
+int kind(int n)
+{
+    int *p;
+    struct s v;
+    struct s *ps;
+    switch (n)
+    {
+    case sizeof(*p):
+        return 1;
+    case sizeof(v.m):
+        return 2;
+    case sizeof(ps->c):
+        return 3;
+    case sizeof(half()):
+        return 4;
+    }
+    return 0;
+}
+
+int main(void)
+{
+    int x;
+    x = 1;
+    int n;
+    n = sizeof(x++);
+    printf("%d %d\n", x, n);
+    n = sizeof(x = 5) + sizeof(--x);
+    printf("%d %d\n", x, n);
+    int i;
+    for (i = 0; i <= 8; ++i)
+        printf("%d", kind(i));
+    printf("\n");
+    return 0;
+}
@@ -0,0 +1,69 @@
+int printf(char*, ...);
+
+struct pair
+{
+    int a;
+    int b;
+};
+
+struct pair make(int a, int b)
+{
+    struct pair p;
+    p.a = a;
+    p.b = b;
+    return p;
+}
+
+void bump(int* p)
+{
+    *p = *p + 1;
+}
+
+int collatz(int n)
+{
+    int steps;
+    steps = 0;
+again:
+    if (n == 1)
+        return steps;
+    steps++;
+    if (n % 2)
+        n = 3 * n + 1;
+    else
+        n /= 2;
+    goto again;
+}
+
+int main(void)
+{
+    int i, j, sum, kept;
+    char c;
+    sum = 0;
+    kept = 0;
+    for (i = 0; i < 10; ++i)
+    {
+        j = i;
+        while (j > 0 && j % 3)
+            j--;
+        switch (i % 4)
+        {
+        case 0:
+            sum += j;
+        case 1:
+            sum++;
+            break;
+        default:
+            if (i > 7)
+                continue;
+            sum = sum * 2;
+        }
+        bump(&kept);
+    }
+    c = sum;
+    j = (i, 5);
+    do
+        c += j--;
+    while (j);
+    printf("%d %d %d %d %d\n", sum, kept, c, make(3, 4).b, collatz(27));
+    return 0;
+}
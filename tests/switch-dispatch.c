@@ -0,0 +1,48 @@
+int printf(char*, ...);
+
+int step(int op, int acc)
+{
+    switch (op)
+    {
+    case 0:
+        return acc;
+    case 1:
+        acc = acc + 1;
+        break;
+    case 2:
+    case 3:
+        acc = acc * op;
+        break;
+    case 'x':
+        acc = 0;
+    case 4 + 4:
+        acc = acc - 8;
+        break;
+    default:
+        acc = -acc;
+    }
+    return acc;
+}
+
+int main(void)
+{
+    int i;
+    int acc;
+    acc = 1;
+    for (i = 0; i < 10; ++i)
+    {
+        switch (i % 3)
+        {
+        case 0:
+            continue;
+        case 1:
+            acc = step(i, acc);
+            break;
+        default:
+            acc = step(i - 1, acc);
+        }
+        printf("%d ", acc);
+    }
+    printf("%d %d\n", step('x', 5), step(8, 5));
+    return 0;
+}
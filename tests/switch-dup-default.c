@@ -0,0 +1,12 @@
+int f(int x)
+{
+    switch (x)
+    {
+    default:
+        return 1;
+    case 2:
+        return 2;
+    default:
+        return 3;
+    }
+}
@@ -1,5 +1,5 @@
 build/debug/c4 --compile tests/$1.c
 cat $1.ll
-llvm/install/bin/clang -o out $1.ll
-llvm/install/bin/llc -o out.s $1.ll
+build/debug/c4 -o out tests/$1.c
+build/debug/c4 --emit-asm -o out.s tests/$1.c
 ./out